@@ -0,0 +1,45 @@
+/* adc_constants.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+#ifndef JDH_16_17_RASPI3_ADC_CONSTANTS_H_
+#define JDH_16_17_RASPI3_ADC_CONSTANTS_H_
+
+// Datasheet: <https://www.nxp.com/documents/user_manual/UM10360.pdf>
+// See page 574 for details on the ADC. p15 on the mbed is P0.23, which is
+// AD0.0; mbed's AnalogIn sets the pin up for us.
+
+// AD0CR (Control Register) bits (datasheet section 29.5.1). The ADC clock is
+// PCLK_ADC / (CLKDIV + 1), and must be 13 MHz or less; a conversion takes 65
+// of its clocks. In burst mode, the ADC converts the selected channels over
+// and over without being told to, and the START bits must be 0.
+#define ADC_CR_SEL_AD0_0 1<<0
+#define ADC_CR_CLKDIV_SHIFT 8
+#define ADC_CR_CLKDIV_MASK 0xFF<<8
+#define ADC_CR_BURST 1<<16
+#define ADC_CR_PDN 1<<21
+#define ADC_CR_START_MASK 7<<24
+
+// AD0INTEN bits (datasheet section 29.5.3). ADGINTEN (bit 8) must be clear for
+// the interrupt to come from a single channel.
+#define ADC_INTEN_AD0_0 1<<0
+
+// AD0DR0 (the result for channel 0, datasheet section 29.5.4). Reading it
+// clears DONE, and with it the interrupt.
+#define ADC_DR_RESULT_SHIFT 4
+#define ADC_DR_RESULT_MASK 0xFFF
+#define ADC_DR_DONE 0x80000000
+
+// Power control bit for the ADC in LPC_SC->PCONP (datasheet section 4.8.9).
+#define SC_PCONP_ADC 1<<12
+
+// PCLKSEL0 bits 25:24 divide the core clock for the ADC (datasheet section
+// 4.7.3); 3 is the slowest, CCLK / 8.
+#define PCLKSEL0_ADC_MASK 3<<24
+#define PCLKSEL0_ADC_CCLK_8 3<<24
+
+#endif  // JDH_16_17_RASPI3_ADC_CONSTANTS_H_
\ No newline at end of file
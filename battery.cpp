@@ -0,0 +1,96 @@
+/* battery.cpp
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+#include "battery.h"
+
+#include "mbed.h"
+
+#include "adc_constants.h"
+#include "interrupt_handlers.h"
+#include "isr_profile.h"
+#include "scheduler.h"
+
+// Each conversion moves the smoothed level 1/16 of the way towards it, which
+// at 720 a second takes out the noise from the motors' switching but still
+// follows a real drop within a few of ScaleSpeed's ticks.
+const int kFilterShift = 4;
+// Once the robot stops, the level takes a while to come back up (and the
+// smoothing slows it down further), so it's only counted as at rest after this
+// many conversions, about 90 ms.
+const int kRecoveryConversions = 64;
+
+// The level, scaled up by 2^kFilterShift so the smoothing doesn't lose bits.
+static uint32_t filter = 0;
+static bool first_sample = true;
+static volatile BatteryReading reading = {0, 0, 0};
+static uint16_t resting_level = 0;
+static uint16_t lowest_level = 0;
+static int stopped_for = 0;  // conversions, or -1 whilst moving
+
+void InitBattery() {
+    // Slowest PCLK and ADC clock: 12 MHz / 256 is 47 kHz, so a conversion
+    // every 1.4 ms.
+    LPC_SC->PCONP |= SC_PCONP_ADC;
+    LPC_SC->PCLKSEL0 = (LPC_SC->PCLKSEL0 & ~(PCLKSEL0_ADC_MASK)) | PCLKSEL0_ADC_CCLK_8;
+    LPC_ADC->ADINTEN = ADC_INTEN_AD0_0;
+    LPC_ADC->ADCR = ADC_CR_SEL_AD0_0 | 255 << ADC_CR_CLKDIV_SHIFT | ADC_CR_PDN | ADC_CR_BURST;
+}
+
+void BatteryHandler() {
+    PROFILE_ISR(kProfileBatteryHandler);
+    uint32_t result = LPC_ADC->ADDR0;  // clears the interrupt
+    if (!(result & ADC_DR_DONE)) {
+        return;
+    }
+    // 12 bits, made into 16 to match read_u16().
+    uint32_t sample = (result >> ADC_DR_RESULT_SHIFT) & ADC_DR_RESULT_MASK;
+    sample = sample << 4 | sample >> 8;
+    if (first_sample) {
+        filter = sample << kFilterShift;
+        first_sample = false;
+    } else {
+        filter += sample - (filter >> kFilterShift);
+    }
+    uint16_t level = (uint16_t)(filter >> kFilterShift);
+
+    // The sag is measured from the level when the robot was last at rest, so
+    // moves one straight after another all count from before the first.
+    if (motion.command == kNone) {
+        if (stopped_for < kRecoveryConversions) {
+            stopped_for++;
+        } else {
+            resting_level = level;
+        }
+    } else {
+        if (stopped_for >= 0 || level < lowest_level) {
+            lowest_level = level;  // (the first time, it has just set off)
+        }
+        stopped_for = -1;
+        reading.sag = resting_level > lowest_level ? resting_level - lowest_level : 0;
+    }
+
+    reading.level = level;
+    reading.timestamp = us_ticker_read();
+    PostEvent(kEventBattery);
+}
+
+uint16_t BatteryLevel() {
+    return reading.level;
+}
+
+BatteryReading ReadBattery() {
+    BatteryReading copy;
+    // The handler runs every 1.4 ms, so it can't get in twice whilst this is
+    // copying.
+    do {
+        copy.timestamp = reading.timestamp;
+        copy.level = reading.level;
+        copy.sag = reading.sag;
+    } while (copy.timestamp != reading.timestamp);
+    return copy;
+}
\ No newline at end of file
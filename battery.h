@@ -0,0 +1,46 @@
+/* battery.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// Keeps track of the motor board voltage (p15) without anything having to wait
+// for it. AnalogIn::read() starts a conversion and waits for it (for several,
+// in fact, since mbed filters them), which was slow inside ScaleSpeed and
+// happened every 4 ms. Instead, the ADC runs in burst mode at its slowest
+// clock, converting p15 over and over by itself about 720 times a second, and
+// BatteryHandler smooths each result as it comes in. Anything, in an interrupt
+// handler or not, can then have the latest level for the cost of a load.
+//
+// battery_voltage (in robot_specific.cpp) still sets p15 up as an analogue
+// input, but don't call its read() once InitBattery() has been: that would
+// take the ADC out of burst mode.
+
+#ifndef JDH_16_17_RASPI3_BATTERY_H_
+#define JDH_16_17_RASPI3_BATTERY_H_
+
+#include <stdint.h>
+
+// Levels are fractions of the 3.3 V full scale, as from AnalogIn::read_u16():
+// 65535 is 3.3 V at p15.
+struct BatteryReading {
+    uint16_t level;      // smoothed over about 20 ms
+    // How far the level dropped below where it was at rest during the
+    // current move, or the last one if the robot is stopped.
+    uint16_t sag;
+    uint32_t timestamp;  // us_ticker_read() at the conversion
+};
+
+// Starts the conversions; then set BatteryHandler as the ADC interrupt
+// handler, and enable it.
+void InitBattery();
+void BatteryHandler();
+// The smoothed level, from no more than about 1.4 ms ago. It's 0 until the
+// first conversion is done.
+uint16_t BatteryLevel();
+// All of it from the same conversion.
+BatteryReading ReadBattery();
+
+#endif  // JDH_16_17_RASPI3_BATTERY_H_
\ No newline at end of file
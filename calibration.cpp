@@ -0,0 +1,286 @@
+/* calibration.cpp
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+#include "calibration.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "mbed.h"
+
+#include "robot_specific.h"
+#include "interrupt_handlers.h"
+#include "motion_queue.h"
+#include "frames.h"
+#include "robot_profile.h"
+#include "gyro.h"
+#include "iap_constants.h"
+
+uint32_t steps_per_centimetre = kDefaultStepsPerCentimetre;
+uint32_t steps_per_degree = kDefaultStepsPerDegree;
+uint32_t steps_per_degree_centimetre = kDefaultStepsPerDegreeCentimetre;
+
+// Change this whenever CalibrationRecord does.
+const uint16_t kCalibrationVersion = 1;
+const uint32_t kCalibrationMagic = 0x424C4143;  // "CALB"
+// How far the robot drives to see whether it goes straight, in mm.
+const int kCalibrationRun = 500;
+const int kRecordSlots = IAP_LAST_SECTOR_SIZE / IAP_MIN_COPY;
+
+// As it is in flash, at the start of a slot of IAP_MIN_COPY bytes.
+struct CalibrationRecord {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length;  // sizeof(CalibrationRecord)
+    uint32_t steps_per_centimetre;
+    uint32_t steps_per_degree;
+    int32_t veer;
+    uint32_t crc;  // of everything before it
+};
+
+typedef void (*IapEntry)(uint32_t* command, uint32_t* result);
+
+// Hundredths of a degree per metre (see calibration.h).
+static int32_t veer = 0;
+static bool saved = false;
+
+enum CalibrationStage {
+    kNotCalibrating,
+    kSpinningLeft,
+    kSpinningRight,
+    kDrivingOut,
+    kDrivingBack
+};
+static CalibrationStage stage = kNotCalibrating;
+static int reply_tag = kUntagged;
+static uint32_t left_steps_per_degree = 0;
+static int32_t run_start_yaw = 0;
+
+static uint32_t Crc32(const uint8_t* bytes, int length) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (int i = 0; i < length; i++) {
+        crc ^= bytes[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static const CalibrationRecord* Slot(int slot) {
+    return (const CalibrationRecord*)((const uint8_t*)IAP_LAST_SECTOR_ADDRESS
+                                      + slot * IAP_MIN_COPY);
+}
+
+static bool IsBlank(const CalibrationRecord* record) {
+    return record->magic == 0xFFFFFFFF;
+}
+
+static bool IsValid(const CalibrationRecord* record) {
+    return record->magic == kCalibrationMagic
+           && record->version == kCalibrationVersion
+           && record->length == sizeof(CalibrationRecord)
+           && record->crc == Crc32((const uint8_t*)record, offsetof(CalibrationRecord, crc));
+}
+
+// Whether |value| is close enough to |default_value| to be believed.
+static bool Plausible(uint32_t value, uint32_t default_value) {
+    return value >= default_value / 2 && value <= 2 * default_value;
+}
+
+static void SetStepsPerCentimetre(uint32_t value) {
+    steps_per_centimetre = value;
+    // It's all down to the size of the wheels, so arcs scale the same way.
+    steps_per_degree_centimetre = (uint32_t)((uint64_t)kDefaultStepsPerDegreeCentimetre
+                                             * value / kDefaultStepsPerCentimetre);
+}
+
+void LoadCalibration() {
+    const CalibrationRecord* found = NULL;
+    for (int i = 0; i < kRecordSlots && !IsBlank(Slot(i)); i++) {
+        if (IsValid(Slot(i))) {
+            found = Slot(i);
+        } else if (Slot(i)->magic == kCalibrationMagic
+                   && Slot(i)->version != kCalibrationVersion) {
+            found = NULL;  // saved later by some other firmware
+        }
+        // Anything else was cut short by a reset; the one before it stands.
+    }
+    if (found && Plausible(found->steps_per_centimetre, kDefaultStepsPerCentimetre)
+        && Plausible(found->steps_per_degree, kDefaultStepsPerDegree)) {
+        SetStepsPerCentimetre(found->steps_per_centimetre);
+        steps_per_degree = found->steps_per_degree;
+        veer = found->veer;
+        saved = true;
+    }
+}
+
+// Runs an IAP command (with interrupts off); returns whether it worked.
+static bool Iap(uint32_t* command) {
+    uint32_t result[5];
+    ((IapEntry)IAP_LOCATION)(command, result);
+    return result[0] == IAP_CMD_SUCCESS;
+}
+
+static bool EraseSector() {
+    uint32_t prepare[3] = {IAP_PREPARE_SECTORS, IAP_LAST_SECTOR, IAP_LAST_SECTOR};
+    uint32_t erase[4] = {IAP_ERASE_SECTORS, IAP_LAST_SECTOR, IAP_LAST_SECTOR,
+                         SystemCoreClock / 1000};
+    __disable_irq();
+    bool ok = Iap(prepare) && Iap(erase);
+    __enable_irq();
+    return ok;
+}
+
+static bool SaveCalibration() {
+    // IAP copies from RAM a word at a time.
+    static uint32_t buffer[IAP_MIN_COPY / 4];
+    int slot = 0;
+    while (slot < kRecordSlots && !IsBlank(Slot(slot))) {
+        slot++;
+    }
+    if (slot == kRecordSlots) {
+        if (!EraseSector()) {
+            return false;
+        }
+        slot = 0;
+    }
+    CalibrationRecord record;
+    record.magic = kCalibrationMagic;
+    record.version = kCalibrationVersion;
+    record.length = sizeof(CalibrationRecord);
+    record.steps_per_centimetre = steps_per_centimetre;
+    record.steps_per_degree = steps_per_degree;
+    record.veer = veer;
+    record.crc = Crc32((const uint8_t*)&record, offsetof(CalibrationRecord, crc));
+    memset(buffer, 0xFF, sizeof(buffer));
+    memcpy(buffer, &record, sizeof(record));
+
+    uint32_t prepare[3] = {IAP_PREPARE_SECTORS, IAP_LAST_SECTOR, IAP_LAST_SECTOR};
+    uint32_t copy[5] = {IAP_COPY_RAM_TO_FLASH, (uint32_t)Slot(slot), (uint32_t)buffer,
+                        IAP_MIN_COPY, SystemCoreClock / 1000};
+    __disable_irq();
+    bool ok = Iap(prepare) && Iap(copy);
+    __enable_irq();
+    saved = ok && IsValid(Slot(slot));
+    return saved;
+}
+
+void SendCalibration(int tag) {
+    uint8_t bytes[kCalibrationData];
+    uint8_t* next = Write32(Write32(bytes, steps_per_centimetre), steps_per_degree);
+    int32_t hundredths = veer > 32767 ? 32767 : (veer < -32767 ? -32767 : veer);
+    next = Write16(next, (uint16_t)hundredths);
+    *next = saved ? 1 : 0;
+    SendFrame('k', tag, bytes, kCalibrationData);
+}
+
+// Queues a move of the robot's own, which nobody is waiting to hear about.
+static void QueueOwnMove(CurrentCommand command, int steps) {
+    MotionSegment segment = MakeSegment(command, steps);
+    segment.tag = kSilent;
+    PushSegment(segment);  // nothing else is queued
+    NotifyMotionQueued();
+}
+
+static void FinishCalibration(char reply) {
+    stage = kNotCalibrating;
+    if (reply == 'k') {
+        SendCalibration(reply_tag);
+    } else {
+        SendReply(reply, reply_tag);
+    }
+}
+
+// Whether the robot is standing still with nothing to do, so that the flash
+// can be written: with interrupts off, nothing would count steps or slow the
+// robot down.
+static bool Idle() {
+    return stage == kNotCalibrating && motion.command == kNone && !SegmentsQueued();
+}
+
+bool StartCalibration(int tag) {
+    if (!Idle() || !turn_trim_enabled) {
+        return false;
+    }
+    stage = kSpinningLeft;
+    reply_tag = tag;
+    QueueOwnMove(kTurnLeft, ScaleQ16(360, steps_per_degree));
+    return true;
+}
+
+void CalibrationMoveDone() {
+    if (stage == kNotCalibrating || motion.command != kNone || SegmentsQueued()) {
+        return;  // not one of ours, or not stopped yet
+    }
+    int run_steps = ScaleQ16((int64_t)kCalibrationRun, steps_per_centimetre, 10);
+    switch (stage) {
+        case kSpinningLeft:
+            left_steps_per_degree = last_turn_steps_per_degree;
+            stage = kSpinningRight;
+            QueueOwnMove(kTurnRight, ScaleQ16(360, steps_per_degree));
+            break;
+        case kSpinningRight: {
+            uint32_t measured = (uint32_t)(((uint64_t)left_steps_per_degree
+                                            + last_turn_steps_per_degree) / 2);
+            if (!Plausible(left_steps_per_degree, kDefaultStepsPerDegree)
+                || !Plausible(last_turn_steps_per_degree, kDefaultStepsPerDegree)) {
+                FinishCalibration('x');
+                break;
+            }
+            steps_per_degree = measured;
+            stage = kDrivingOut;
+            run_start_yaw = yaw;
+            QueueOwnMove(kMoveForward, run_steps);
+            break;
+        }
+        case kDrivingOut: {
+            if (motion.collided) {
+                FinishCalibration('e');
+                break;
+            }
+            int64_t turned = YawSince(run_start_yaw);
+            veer = (int32_t)(turned * 100 * 1000 / kCalibrationRun / kGyroUnitsPerDegree);
+            stage = kDrivingBack;
+            QueueOwnMove(kMoveBackward, run_steps);
+            break;
+        }
+        case kDrivingBack:
+            if (motion.collided) {
+                FinishCalibration('e');
+                break;
+            }
+            FinishCalibration(SaveCalibration() ? 'k' : 'x');
+            break;
+        default:
+            break;
+    }
+}
+
+bool CalibrateDistance(int intended, int actual) {
+    if (intended <= 0 || actual <= 0 || !Idle()) {
+        return false;
+    }
+    uint32_t measured = (uint32_t)((uint64_t)steps_per_centimetre * intended / actual);
+    if (!Plausible(measured, kDefaultStepsPerCentimetre)) {
+        return false;
+    }
+    SetStepsPerCentimetre(measured);
+    return SaveCalibration();
+}
+
+bool ForgetCalibration() {
+    if (!Idle()) {
+        return false;
+    }
+    SetStepsPerCentimetre(kDefaultStepsPerCentimetre);
+    steps_per_degree = kDefaultStepsPerDegree;
+    veer = 0;
+    saved = false;
+    return EraseSector();
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+/* calibration.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// How many steps make a centimetre and a degree. They start off as the
+// defaults worked out from the size of the robot (see robot_specific.h), but
+// tyres wear and slip and robots get rebuilt, so they can be measured on the
+// robot and kept in flash, where LoadCalibration() finds them at start-up.
+//
+// kOpCalibrate (see frames.h) has the robot measure its own turns: it spins a
+// whole turn to the left and then one to the right, by the steps it thinks
+// make a degree, and sees how far the gyro says it really went (both ways, so
+// that whatever is left of the gyro's offset cancels out). The turns are
+// trimmed as usual, so it ends up facing the way it started. Then it drives
+// kCalibrationRun forwards and back again, to see how far it veers off a
+// straight line. Nothing can be done about that on the robot, since both
+// wheels share a step clock, but the Pi can allow for it. The gyro can't tell
+// how far the robot has gone, so the Pi measures that (with the camera, say)
+// and sends a kOpCalibrateDistance. Don't send any moves until the reply has
+// come back.
+//
+// The calibration is saved in the last sector of flash (see iap_constants.h)
+// as a record with a version number and a CRC-32. Each save goes in the next
+// 256 bytes that are still blank, so the sector only has to be erased every
+// 128 saves, and the last good record is the one that counts. A record saved
+// by firmware with a different kCalibrationVersion is ignored, and the
+// defaults are used instead. Interrupts are off whilst the flash is written
+// (a millisecond or so, or a tenth of a second if it has to be erased), which
+// is fine with the robot standing still.
+//
+// A calibration reply is 'k', then kCalibrationData bytes:
+//     steps per centimetre and per degree (Q16.16, 32 bits each)
+//     how far the robot veered on the straight, in hundredths of a degree per
+//     metre, anticlockwise positive (16 bits, signed; 0 until measured)
+//     1 if the calibration is saved in flash, 0 if it's the defaults (8 bits)
+// or 'x' if it couldn't be done (the robot was moving, there's no gyro, the
+// flash couldn't be written, or the measurements were too far out to
+// believe), or 'e' if the robot hit something.
+
+#ifndef JDH_16_17_RASPI3_CALIBRATION_H_
+#define JDH_16_17_RASPI3_CALIBRATION_H_
+
+#include <stdint.h>
+
+// In Q16.16, like the defaults in robot_specific.h; convert with ScaleQ16().
+// Only change them with the functions below.
+extern uint32_t steps_per_centimetre;
+extern uint32_t steps_per_degree;
+extern uint32_t steps_per_degree_centimetre;
+
+const int kCalibrationData = 11;
+
+// Call once at start-up, before anything moves.
+void LoadCalibration();
+// Starts measuring the turns, and replies with |tag| once that's done; returns
+// false (and does nothing) if it can't start.
+bool StartCalibration(int tag);
+// Call from main() whenever a move has finished.
+void CalibrationMoveDone();
+// The robot was told to go |intended| mm straight, and went |actual| mm: make
+// steps_per_centimetre match, and save it. Returns false if it can't,
+// including whilst the robot is moving or has moves queued.
+bool CalibrateDistance(int intended, int actual);
+// Goes back to the defaults, and erases the saved calibration. Returns false
+// (and does nothing) whilst the robot is moving or has moves queued.
+bool ForgetCalibration();
+// Replies with the calibration, as above.
+void SendCalibration(int tag);
+
+#endif  // JDH_16_17_RASPI3_CALIBRATION_H_
\ No newline at end of file
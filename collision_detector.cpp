@@ -0,0 +1,80 @@
+/* collision_detector.cpp
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+#include "collision_detector.h"
+
+static const int kJerkFastShift = 1;
+static const int kJerkSlowShift = 4;
+
+EmaDetector::EmaDetector(int shift, int threshold)
+        : shift_(shift), threshold_(threshold), sum_(0) {}
+
+void EmaDetector::Reset() {
+    sum_ = 0;
+}
+
+bool EmaDetector::Update(int16_t rate) {
+    sum_ += rate - (sum_ >> shift_);
+    int32_t mean = sum_ >> shift_;
+    return mean > threshold_ || mean < -threshold_;
+}
+
+int32_t EmaDetector::Level() const {
+    int32_t mean = sum_ >> shift_;
+    return mean < 0 ? -mean : mean;
+}
+
+CusumDetector::CusumDetector(int slack, int limit)
+        : slack_(slack), limit_(limit), high_(0), low_(0) {}
+
+void CusumDetector::Reset() {
+    high_ = 0;
+    low_ = 0;
+}
+
+bool CusumDetector::Update(int16_t rate) {
+    high_ += rate - slack_;
+    if (high_ < 0) {
+        high_ = 0;
+    }
+    low_ += -rate - slack_;
+    if (low_ < 0) {
+        low_ = 0;
+    }
+    if (high_ > limit_ || low_ > limit_) {
+        // Stop the sums growing without bound if nobody resets them.
+        high_ = high_ > limit_ ? limit_ + 1 : high_;
+        low_ = low_ > limit_ ? limit_ + 1 : low_;
+        return true;
+    }
+    return false;
+}
+
+int32_t CusumDetector::Level() const {
+    return high_ > low_ ? high_ : low_;
+}
+
+JerkDetector::JerkDetector(int threshold)
+        : threshold_(threshold), fast_(0), slow_(0) {}
+
+void JerkDetector::Reset() {
+    fast_ = 0;
+    slow_ = 0;
+}
+
+bool JerkDetector::Update(int16_t rate) {
+    fast_ += rate - (fast_ >> kJerkFastShift);
+    slow_ += rate - (slow_ >> kJerkSlowShift);
+    int32_t change = (fast_ >> kJerkFastShift) - (slow_ >> kJerkSlowShift);
+    return change > threshold_ || change < -threshold_;
+}
+
+int32_t JerkDetector::Level() const {
+    int32_t change = (fast_ >> kJerkFastShift) - (slow_ >> kJerkSlowShift);
+    return change < 0 ? -change : change;
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+/* collision_detector.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// Ways of deciding from the gyro's Z rate that the robot has hit something
+// whilst driving straight. Each takes one raw sample at a time (131 per
+// degree/s, at kGyroSampleRateHz) and keeps only a few words of state, so they
+// can react within a few samples instead of waiting for a long average to
+// catch up. main() uses one of them; host/replay.cpp compares them all on
+// recorded gyro traces.
+//
+// They treat 0 as not turning, so they're given samples with the gyro's own
+// offset taken out (see gyro_bias.h). With that gone, the thresholds only have
+// to allow for noise, vibration and the robot lurching, not for however far
+// out the gyro happens to be today.
+
+#ifndef JDH_16_17_RASPI3_COLLISION_DETECTOR_H_
+#define JDH_16_17_RASPI3_COLLISION_DETECTOR_H_
+
+#include <stdint.h>
+
+// Samples to ignore at the start of each move, whilst the robot lurches into
+// motion: 12 ms.
+const int kCollisionSettleSamples = 12;
+
+// Starting points for the thresholds, in raw units. See host/replay.cpp for
+// how to try others.
+const int kEmaShift = 4;  // time constant of 2^4 samples
+const int kEmaThreshold = 25;  // about 0.2 degrees/s
+const int kCusumSlack = 10;
+const int kCusumLimit = 800;
+const int kJerkThreshold = 100;
+
+class CollisionDetector {
+  public:
+    virtual ~CollisionDetector() {}
+    // Forgets everything it has seen, ready for a new move.
+    virtual void Reset() = 0;
+    // Takes the next sample, and returns true if the robot seems to have hit
+    // something.
+    virtual bool Update(int16_t rate) = 0;
+    // How close it is to triggering, in the same units as its threshold (for
+    // the telemetry; see telemetry.h).
+    virtual int32_t Level() const = 0;
+};
+
+// An exponential moving average of the rate, which triggers when it strays
+// more than |threshold| from 0. The nearest thing to the old 1024-sample
+// average, but with a time constant of 2^|shift| samples and no buffer.
+class EmaDetector : public CollisionDetector {
+  public:
+    EmaDetector(int shift = kEmaShift, int threshold = kEmaThreshold);
+    void Reset();
+    bool Update(int16_t rate);
+    int32_t Level() const;
+  private:
+    const int shift_;
+    const int threshold_;
+    int32_t sum_;  // the average, times 2^shift_
+};
+
+// Two-sided CUSUM: adds up how far each sample is beyond +-|slack|, forgetting
+// whenever the total goes back to 0, and triggers when it passes |limit|. A
+// big turn is caught in a few samples and a small one eventually, whilst noise
+// within the slack never builds up.
+class CusumDetector : public CollisionDetector {
+  public:
+    CusumDetector(int slack = kCusumSlack, int limit = kCusumLimit);
+    void Reset();
+    bool Update(int16_t rate);
+    int32_t Level() const;
+  private:
+    const int slack_;
+    const int limit_;
+    int32_t high_;
+    int32_t low_;
+};
+
+// Looks at how suddenly the rate changes rather than at the rate itself: the
+// difference between a fast (2-sample) and a slow (16-sample) moving average,
+// which triggers when it's more than |threshold|. Good at the jolt of an
+// impact, but blind to a rate that creeps up slowly.
+class JerkDetector : public CollisionDetector {
+  public:
+    JerkDetector(int threshold = kJerkThreshold);
+    void Reset();
+    bool Update(int16_t rate);
+    int32_t Level() const;
+  private:
+    const int threshold_;
+    int32_t fast_;  // times 2
+    int32_t slow_;  // times 16
+};
+
+#endif  // JDH_16_17_RASPI3_COLLISION_DETECTOR_H_
\ No newline at end of file
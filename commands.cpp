@@ -0,0 +1,478 @@
+/* commands.cpp
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * Written by Josh Holland <anowlcalledjosh@gmail.com>
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+#include "commands.h"
+
+#include "mbed.h"
+
+#include "robot_specific.h"
+#include "interrupt_handlers.h"
+#include "motion_queue.h"
+#include "serial_tx.h"
+#include "frames.h"
+#include "isr_profile.h"
+#include "battery.h"
+#include "gyro.h"
+#include "telemetry.h"
+#include "pose.h"
+#include "calibration.h"
+
+enum State {
+    kReadyForCommand,
+    // k*Received means "waiting for argument(s)", i.e. how far to move
+    kForwardReceived,
+    kLowPowerReceived,
+    kBackwardReceived,
+    kLongDistanceReceived,
+    kLeftReceived,
+    kRightReceived,
+    // An arc takes two: the angle, then the radius.
+    kArcReceived,
+    kArcAngleReceived,
+    // Part-way through a frame (see frames.h).
+    kFrameReceived
+};
+
+static State robot_state = kReadyForCommand;
+static char dip_switch_state = 0;
+// The arc whose arguments are arriving.
+static CurrentCommand arc_command = kNone;
+static uint8_t arc_angle = 0;
+static FrameReader frame_reader;
+
+// DigitalOuts are inherently "volatile", so they don't need to be explicitly
+// declared as such. If they are, things break.
+DigitalOut led_left(p14);
+DigitalOut led_right(p10);
+
+// Queues a move; PwmHandler starts it straight away if the robot isn't already
+// moving. If there's no room for it, says so with an 'x' instead of the usual
+// reply. |tag| is the sequence number of the request if it came in a frame,
+// otherwise kUntagged.
+static void QueueSegment(MotionSegment segment, int tag) {
+    segment.tag = tag;
+    if (!PushSegment(segment)) {
+        SendReply('x', tag);
+        return;
+    }
+    NotifyMotionQueued();
+}
+
+static void QueueMove(CurrentCommand command, int steps, int tag) {
+    QueueSegment(MakeSegment(command, steps), tag);
+}
+
+// The same, but the move is low power ('A'; see MotionSegment).
+static void QueueLowPowerMove(CurrentCommand command, int steps, int tag) {
+    MotionSegment segment = MakeSegment(command, steps);
+    segment.low_power = true;
+    QueueSegment(segment, tag);
+}
+
+// Carries on with the move a collision paused, from rest and with the usual
+// ramp, or says 'x' if there isn't one.
+static void ResumeMove(int tag) {
+    PausedMove move;
+    if (!TakePausedMove(&move)) {
+        SendReply('x', tag);
+        return;
+    }
+    MotionSegment segment = MakeSegment(move.command, move.steps);
+    segment.low_power = move.low_power;
+    QueueSegment(segment, tag);
+}
+
+// Queues an arc of |centidegrees| hundredths of a degree, with the middle of
+// the robot going round a circle of |millimetres| radius. If the radius is
+// less than half the width of the robot, the inner wheel goes backwards.
+static void QueueArc(CurrentCommand command, int centidegrees, int millimetres, int tag) {
+#if SEPARATE_STEP_CLOCKS
+    // The middle of the robot goes along the arc, and each wheel goes that far
+    // plus or minus what it would take to turn on the spot.
+    int middle = ScaleQ16((int64_t)centidegrees * millimetres, steps_per_degree_centimetre, 1000);
+    int turn = ScaleQ16(centidegrees, steps_per_degree, 100);
+    QueueSegment(MakeArc(command, middle + turn, middle - turn), tag);
+#else
+    (void)command;
+    (void)centidegrees;
+    (void)millimetres;
+    SendReply('x', tag);  // both wheels have to take the same steps
+#endif
+}
+
+// How far out the last turn finished, as the gyro saw it, in tenths of a
+// degree (positive if it should have gone further left), as one signed byte.
+// The two bytes the Pi would take for something else, kFrameSync (-9.1
+// degrees) and kReadyByte (-6.3), go a tenth closer to 0 instead.
+static char LastTurnError() {
+    int tenths = last_turn_error * 10 / kGyroUnitsPerDegree;
+    if (tenths > 127) {
+        tenths = 127;
+    } else if (tenths < -127) {
+        tenths = -127;
+    }
+    if ((char)tenths == (char)kFrameSync || (char)tenths == kReadyByte) {
+        tenths++;
+    }
+    return (char)tenths;
+}
+
+// Little-endian numbers from a frame.
+static int Read16(const uint8_t* bytes) {
+    return bytes[0] | bytes[1] << 8;
+}
+
+static int32_t ReadSigned32(const uint8_t* bytes) {
+    return (int32_t)(bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24);
+}
+
+// Steps can't be more than an int can hold.
+static int ReadSteps(const uint8_t* bytes) {
+    uint32_t steps = bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+    return steps > 0x7fffffff ? 0x7fffffff : (int)steps;
+}
+
+// How many bytes of arguments follow |opcode| and its sequence number, or -1
+// if it isn't one.
+static int ArgumentBytes(uint8_t opcode) {
+    switch (opcode) {
+        case kOpForward:
+        case kOpBackward:
+        case kOpLeft:
+        case kOpRight:
+        case kOpForwardLowPower:
+            return 2;
+        case kOpArcLeft:
+        case kOpArcRight:
+        case kOpForwardSteps:
+        case kOpBackwardSteps:
+        case kOpLeftSteps:
+        case kOpRightSteps:
+            return 4;
+        case kOpContinue:
+        case kOpDipSwitch:
+        case kOpTurnError:
+        case kOpBattery:
+        case kOpPose:
+            return 0;
+        case kOpSetPose:
+            return 10;
+        case kOpPosePeriod:
+            return 2;
+        case kOpCalibrate:
+            return 1;
+        case kOpCalibrateDistance:
+            return 4;
+#if TELEMETRY
+        case kOpTelemetry:
+            return 2;
+#endif
+#if ISR_PROFILING
+        case kOpIsrProfile:
+        case kOpIsrHistogram:
+            return 1;
+#endif
+        default:
+            return -1;
+    }
+}
+
+// Carries out one request from a frame, whose arguments start at |args|.
+static void ProcessRequest(uint8_t opcode, uint8_t seq, const uint8_t* args) {
+    switch (opcode) {
+        case kOpForward:
+            QueueMove(kMoveForward, ScaleQ16(Read16(args), steps_per_centimetre, 10), seq);
+            break;
+        case kOpForwardLowPower:
+            QueueLowPowerMove(kMoveForward, ScaleQ16(Read16(args), steps_per_centimetre, 10), seq);
+            break;
+        case kOpBackward:
+            QueueMove(kMoveBackward, ScaleQ16(Read16(args), steps_per_centimetre, 10), seq);
+            break;
+        case kOpLeft:
+            led_left = 1;
+            led_right = 0;
+            QueueMove(kTurnLeft, ScaleQ16(Read16(args), steps_per_degree, 100), seq);
+            break;
+        case kOpRight:
+            led_right = 1;
+            led_left = 0;
+            QueueMove(kTurnRight, ScaleQ16(Read16(args), steps_per_degree, 100), seq);
+            break;
+        case kOpArcLeft:
+            QueueArc(kArcLeft, Read16(args), Read16(args + 2), seq);
+            break;
+        case kOpArcRight:
+            QueueArc(kArcRight, Read16(args), Read16(args + 2), seq);
+            break;
+        case kOpForwardSteps:
+            QueueMove(kMoveForward, ReadSteps(args), seq);
+            break;
+        case kOpBackwardSteps:
+            QueueMove(kMoveBackward, ReadSteps(args), seq);
+            break;
+        case kOpLeftSteps:
+            QueueMove(kTurnLeft, ReadSteps(args), seq);
+            break;
+        case kOpRightSteps:
+            QueueMove(kTurnRight, ReadSteps(args), seq);
+            break;
+        case kOpContinue:
+            ResumeMove(seq);
+            break;
+        case kOpDipSwitch: {
+            uint8_t state = (uint8_t)dip_switch.read();
+            SendFrame('s', seq, &state, 1);
+            break;
+        }
+        case kOpTurnError: {
+            int64_t hundredths = (int64_t)last_turn_error * 100 / kGyroUnitsPerDegree;
+            if (hundredths > 32767) {
+                hundredths = 32767;
+            } else if (hundredths < -32767) {
+                hundredths = -32767;
+            }
+            uint8_t bytes[2] = {(uint8_t)hundredths, (uint8_t)(hundredths >> 8)};
+            SendFrame('t', seq, bytes, 2);
+            break;
+        }
+        case kOpBattery: {
+            BatteryReading battery = ReadBattery();
+            uint8_t bytes[8];
+            Write32(Write16(Write16(bytes, battery.level), battery.sag), battery.timestamp);
+            SendFrame('v', seq, bytes, 8);
+            break;
+        }
+        case kOpSetPose:
+        case kOpPosePeriod:
+        case kOpPose: {
+            if (opcode == kOpSetPose) {
+                SetPose(ReadSigned32(args), ReadSigned32(args + 4), (int16_t)Read16(args + 8));
+            } else if (opcode == kOpPosePeriod) {
+                SetPosePeriod(Read16(args));
+            }
+            UpdatePose();
+            uint8_t bytes[kPoseData];
+            WritePose(bytes, CurrentPose());
+            SendFrame('w', seq, bytes, kPoseData);
+            break;
+        }
+        case kOpCalibrate:
+            if (args[0] == 1) {
+                // It replies once the robot has finished measuring.
+                if (!StartCalibration(seq)) {
+                    SendReply('x', seq);
+                }
+            } else if (args[0] == 2) {
+                if (ForgetCalibration()) {
+                    SendCalibration(seq);
+                } else {
+                    SendReply('x', seq);
+                }
+            } else if (args[0] == 0) {
+                SendCalibration(seq);
+            } else {
+                SendReply('?', seq);
+            }
+            break;
+        case kOpCalibrateDistance:
+            if (CalibrateDistance(Read16(args), Read16(args + 2))) {
+                SendCalibration(seq);
+            } else {
+                SendReply('x', seq);
+            }
+            break;
+#if TELEMETRY
+        case kOpTelemetry: {
+            SetTelemetryPeriod(Read16(args));
+            uint8_t bytes[4];
+            Write32(bytes, TelemetryDropped());
+            SendFrame('m', seq, bytes, 4);
+            break;
+        }
+#endif
+#if ISR_PROFILING
+        case kOpIsrProfile:
+        case kOpIsrHistogram: {
+            if (args[0] >= kProfiledHandlers) {
+                SendReply('?', seq);
+                break;
+            }
+            // Copied with interrupts off, so that it all comes from the same
+            // moment.
+            __disable_irq();
+            IsrProfile profile = IsrProfileFor((ProfiledHandler)args[0]);
+            __enable_irq();
+            uint8_t bytes[kMaxReplyData];
+            uint8_t* next = bytes;
+            *next++ = args[0];
+            if (opcode == kOpIsrProfile) {
+                next = Write32(next, profile.calls);
+                next = Write32(next, profile.min_cycles);
+                next = Write32(next, profile.max_cycles);
+                next = Write32(next, profile.calls
+                                     ? (uint32_t)(profile.total_cycles / profile.calls) : 0);
+                next = Write32(next, profile.min_interval);
+                next = Write32(next, profile.max_interval);
+            } else {
+                for (int i = 0; i < kIsrHistogramBins; i++) {
+                    next = Write16(next, profile.histogram[i]);
+                }
+            }
+            SendFrame(opcode == kOpIsrProfile ? 'p' : 'h', seq, bytes, next - bytes);
+            break;
+        }
+#endif
+    }
+}
+
+// Carries out each request in a frame, in order.
+static void ProcessFrame(const uint8_t* body, int length) {
+    int i = 0;
+    while (i < length) {
+        if (length - i < 2) {
+            SendFrame('?', kUntagged, NULL, 0);  // not even a sequence number
+            return;
+        }
+        uint8_t opcode = body[i];
+        uint8_t seq = body[i + 1];
+        int args = ArgumentBytes(opcode);
+        if (args < 0 || i + 2 + args > length) {
+            // Without knowing how long it is, the rest can't be made sense of.
+            SendReply('?', seq);
+            return;
+        }
+        ProcessRequest(opcode, seq, body + i + 2);
+        i += 2 + args;
+    }
+}
+
+// Deals with one byte from the Pi.
+static void ProcessCommand(uint8_t character) {
+    switch (robot_state) {
+        case kReadyForCommand:
+            switch (character) {
+                case 'f':  // move forwards
+                    robot_state = kForwardReceived;
+                    break;
+                case 'b':  // move backwards
+                    robot_state = kBackwardReceived;
+                    break;
+                case 'F':  // move forwards lots
+                    robot_state = kLongDistanceReceived;
+                    break;
+                case 'l':  // turn left
+                    led_left = 1;
+                    led_right = 0;
+                    robot_state = kLeftReceived;
+                    break;
+                case 'r':  // turn right
+                    led_right = 1;
+                    led_left = 0;
+                    robot_state = kRightReceived;
+                    break;
+                case 'L':  // go round an arc to the left
+                    arc_command = kArcLeft;
+                    robot_state = kArcReceived;
+                    break;
+                case 'R':  // go round an arc to the right
+                    arc_command = kArcRight;
+                    robot_state = kArcReceived;
+                    break;
+                case 's':  // get DIP switch state
+                    dip_switch_state = (char)dip_switch.read();
+                    SerialSend(dip_switch_state);
+                    break;
+                case 't':  // how far out was the last turn?
+                    SerialSend(LastTurnError());
+                    break;
+                case 'c': // continue after a collision with whatever was being done
+                    // Only once the robot has replied 'e'; 'x' if nothing was
+                    // paused.
+                    ResumeMove(kUntagged);
+                    robot_state = kReadyForCommand;
+                    break;
+                case 'A':  // move forwards, without going flat out
+                    robot_state = kLowPowerReceived;
+                    break;
+                case kFrameSync:  // the start of a frame
+                    robot_state = kFrameReceived;
+                    break;
+            }
+            break;
+        // The argument is unsigned: the Pi sends distances and angles of up
+        // to 255, not -128 to 127.
+        case kForwardReceived:
+            QueueMove(kMoveForward, ScaleQ16(character, steps_per_centimetre), kUntagged);
+            robot_state = kReadyForCommand;
+            break;
+        case kLowPowerReceived:
+            QueueLowPowerMove(kMoveForward, ScaleQ16(character, steps_per_centimetre),
+                              kUntagged);
+            robot_state = kReadyForCommand;
+            break;
+        case kBackwardReceived:
+            QueueMove(kMoveBackward, ScaleQ16(character, steps_per_centimetre), kUntagged);
+            robot_state = kReadyForCommand;
+            break;
+        case kLongDistanceReceived:
+            QueueMove(kMoveLongDistance, ScaleQ16(character * 10, steps_per_centimetre),
+                      kUntagged);
+            robot_state = kReadyForCommand;
+            break;
+        case kLeftReceived:
+            QueueMove(kTurnLeft, ScaleQ16(character, steps_per_degree), kUntagged);
+            robot_state = kReadyForCommand;
+            break;
+        case kRightReceived:
+            QueueMove(kTurnRight, ScaleQ16(character, steps_per_degree), kUntagged);
+            robot_state = kReadyForCommand;
+            break;
+        case kArcReceived:
+            arc_angle = character;
+            robot_state = kArcAngleReceived;
+            break;
+        case kArcAngleReceived:
+            QueueArc(arc_command, arc_angle * 100, character * 10, kUntagged);
+            robot_state = kReadyForCommand;
+            break;
+        case kFrameReceived:
+            switch (frame_reader.Add(character)) {
+                case FrameReader::kComplete:
+                    ProcessFrame(frame_reader.body(), frame_reader.length());
+                    robot_state = kReadyForCommand;
+                    break;
+                case FrameReader::kBadFrame:
+                    SendFrame('!', kUntagged, NULL, 0);
+                    robot_state = kReadyForCommand;
+                    break;
+                case FrameReader::kNotAFrame:
+                    // The kFrameSync was a stray, and this is a command.
+                    robot_state = kReadyForCommand;
+                    ProcessCommand(character);
+                    break;
+                case FrameReader::kIncomplete:
+                    break;
+            }
+            break;
+    }
+}
+
+void ProcessCommands() {
+    SerialByte byte;
+    while (serial_rx.Pop(&byte)) {
+        if (byte.after_gap && robot_state == kFrameReceived) {
+            // The rest of the frame never came (see frames.h).
+            frame_reader.Reset();
+            robot_state = kReadyForCommand;
+        }
+        ProcessCommand((uint8_t)byte.character);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+/* commands.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// Works out what the Pi has asked for. SerialHandler only stores the bytes it
+// receives (in serial_rx); they're decoded here, from main()'s loop, so that
+// the serial interrupt is always short enough not to get in the way of the
+// step interrupts.
+
+#ifndef JDH_16_17_RASPI3_COMMANDS_H_
+#define JDH_16_17_RASPI3_COMMANDS_H_
+
+// Goes up whenever the Pi would need to know that something has changed, e.g.
+// a new opcode (see frames.h) or a different reply.
+const int kProtocolVersion = 1;
+// Sent on its own (outside any frame) once, when the robot is ready for
+// commands after being reset: the Pi can tell from it that the robot has
+// restarted (after a brown-out, say) and which protocol it speaks. No other
+// reply is ever kReadyByte or kFrameSync: the letters can't be, and the legacy
+// 't' reply steps round them (see LastTurnError() in commands.cpp). Anything
+// sent before it isn't lost, but waits to be carried out until then.
+const char kReadyByte = (char)(0xC0 + kProtocolVersion);
+
+// Deals with every byte received so far. Call it often: at 115200 baud,
+// serial_rx fills up in a few milliseconds if nothing empties it.
+void ProcessCommands();
+
+#endif  // JDH_16_17_RASPI3_COMMANDS_H_
\ No newline at end of file
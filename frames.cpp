@@ -0,0 +1,80 @@
+/* frames.cpp
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+#include "frames.h"
+
+#include <stddef.h>
+
+#include "serial_tx.h"
+
+const int kMaxReplyBody = 2 + kMaxReplyData;
+
+uint8_t Crc8(uint8_t crc, uint8_t byte) {
+    crc ^= byte;
+    for (int bit = 0; bit < 8; bit++) {
+        crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+FrameReader::Result FrameReader::Add(uint8_t byte) {
+    if (received_ == 0) {
+        if (byte == 0 || byte > kMaxFrameBody) {
+            Reset();
+            return kNotAFrame;
+        }
+        length_ = byte;
+        crc_ = Crc8(0, byte);
+        received_ = 1;
+        return kIncomplete;
+    }
+    if (received_ <= length_) {
+        body_[received_ - 1] = byte;
+        crc_ = Crc8(crc_, byte);
+        received_++;
+        return kIncomplete;
+    }
+    // That was the CRC.
+    received_ = 0;
+    return byte == crc_ ? kComplete : kBadFrame;
+}
+
+bool SendFrame(char reply, int seq, const uint8_t* data, int length) {
+    char frame[kMaxReplyBody + 3];
+    int body = 1 + (seq != kUntagged) + length;
+    if (body > kMaxReplyBody) {
+        return false;
+    }
+    int n = 0;
+    frame[n++] = (char)kFrameSync;
+    frame[n++] = (char)body;
+    frame[n++] = reply;
+    if (seq != kUntagged) {
+        frame[n++] = (char)seq;
+    }
+    for (int i = 0; i < length; i++) {
+        frame[n++] = (char)data[i];
+    }
+    uint8_t crc = 0;
+    for (int i = 1; i < n; i++) {
+        crc = Crc8(crc, (uint8_t)frame[i]);
+    }
+    frame[n++] = (char)crc;
+    return SerialSendBytes(frame, n);
+}
+
+void SendReply(char reply, int tag) {
+    if (tag == kSilent) {
+        return;
+    }
+    if (tag == kUntagged) {
+        SerialSend(reply);
+    } else {
+        SendFrame(reply, tag, NULL, 0);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,147 @@
+/* frames.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// The framed protocol, which the Pi can use alongside the one-character
+// commands: whenever the robot is waiting for a command, kFrameSync starts a
+// frame instead. Each frame, in either direction, is
+//     kFrameSync, length, body (|length| bytes), CRC-8
+// where the CRC (polynomial 0x07, starting from 0, as used by SMBus) covers
+// the length and the body. Numbers are little-endian.
+//
+// A frame from the Pi holds one or more requests, each an opcode, a sequence
+// number and the opcode's arguments (see FrameOpcode). They're dealt with in
+// order, so a whole leg of a route can be sent in one go. Every request gets
+// a frame back with the character the one-character protocol would have sent
+// (e.g. 'f' when a forward move has finished, 'e' after a collision, 'x' if
+// the motion queue was full), the request's sequence number, and the answer to
+// a query. An unknown opcode, or arguments that run off the end of the frame,
+// get a '?', and the rest of the frame is ignored. A frame with a bad CRC gets
+// a '!' with no sequence number, since it can't be trusted. The robot only
+// sends a frame of its own accord if asked to (see kOpPosePeriod), and those
+// have no sequence number either. After a reset, the first thing it sends is
+// kReadyByte (see commands.h), on its own.
+//
+// A kFrameSync can also turn up by mistake amongst one-character commands, so
+// it only starts a frame if the byte after it could be a length; if not, it's
+// forgotten, and that byte is taken as a command. Likewise, a frame that
+// stops for more than kFrameGapUs part-way through is forgotten without a
+// reply, and the byte after the gap is taken afresh. The Pi should send each
+// frame in one go.
+
+#ifndef JDH_16_17_RASPI3_FRAMES_H_
+#define JDH_16_17_RASPI3_FRAMES_H_
+
+#include <stdint.h>
+
+const uint8_t kFrameSync = 0xA5;
+// The longest body a frame can have: a full motion queue's worth of moves,
+// and then some.
+const int kMaxFrameBody = 64;
+// The longest pause there can be between the bytes of a frame, in us.
+const uint32_t kFrameGapUs = 10000;
+
+enum FrameOpcode {
+    kOpForward = 0x01,          // millimetres (16 bits)
+    kOpBackward = 0x02,         // millimetres (16 bits)
+    kOpLeft = 0x03,             // hundredths of a degree (16 bits)
+    kOpRight = 0x04,            // hundredths of a degree (16 bits)
+    kOpArcLeft = 0x05,          // hundredths of a degree, then radius in mm (16 bits each)
+    kOpArcRight = 0x06,         // as kOpArcLeft
+    kOpForwardLowPower = 0x07,  // millimetres (16 bits), like 'A'
+    kOpForwardSteps = 0x10,     // steps (32 bits)
+    kOpBackwardSteps = 0x11,    // steps (32 bits)
+    kOpLeftSteps = 0x12,        // steps (32 bits)
+    kOpRightSteps = 0x13,       // steps (32 bits)
+    kOpContinue = 0x20,         // like 'c'
+    kOpDipSwitch = 0x21,        // replies 's' and the DIP switch (8 bits)
+    kOpTurnError = 0x22,        // replies 't' and hundredths of a degree (signed 16 bits)
+    // With ISR_PROFILING (see isr_profile.h); the argument is a ProfiledHandler
+    // (8 bits), which is echoed back. The answers are long, so ask for a
+    // couple at a time at most, or some will be lost from serial_tx.
+    kOpIsrProfile = 0x23,       // replies 'p', then calls, and the shortest,
+                                // longest and mean time and the shortest and
+                                // longest interval in cycles (32 bits each)
+    kOpIsrHistogram = 0x24,     // replies 'h', then the histogram (16 bits a bin)
+    kOpBattery = 0x25,          // replies 'v', then the level and sag (16 bits each)
+                                // and the timestamp in us (32 bits); see battery.h
+    // With TELEMETRY (see telemetry.h).
+    kOpTelemetry = 0x26,        // period in ms (16 bits, 0 for none); replies 'm',
+                                // then frames dropped so far (32 bits)
+    // See pose.h.
+    kOpPose = 0x27,             // replies 'w' and the pose
+    kOpSetPose = 0x28,          // x and y in mm (signed 32 bits each), heading in
+                                // hundredths of a degree (signed 16 bits); replies
+                                // as kOpPose
+    kOpPosePeriod = 0x29,       // ms between 'W' frames whilst moving (16 bits, 0
+                                // for none); replies as kOpPose
+    // See calibration.h.
+    kOpCalibrate = 0x2A,        // 0 (8 bits) to ask, 1 to measure the turns, 2 to go
+                                // back to the defaults; replies 'k' and the
+                                // calibration, once it's done
+    kOpCalibrateDistance = 0x2B // mm the robot was told to go straight, then mm it
+                                // really went (16 bits each); replies as kOpCalibrate
+};
+
+// Given to SendReply() for a move that came from a one-character command.
+const int kUntagged = -1;
+// Given to SendReply() for a move the robot queued itself (see
+// calibration.h), which the Pi isn't waiting to hear about.
+const int kSilent = -2;
+
+// Adds |byte| to a CRC-8.
+uint8_t Crc8(uint8_t crc, uint8_t byte);
+
+// Put |value| into |bytes|, little-endian, and return where the next value
+// goes.
+inline uint8_t* Write16(uint8_t* bytes, uint32_t value) {
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+    return bytes + 2;
+}
+
+inline uint8_t* Write32(uint8_t* bytes, uint32_t value) {
+    return Write16(Write16(bytes, value), value >> 16);
+}
+
+// Puts a frame back together a byte at a time, once its kFrameSync has been
+// seen.
+class FrameReader {
+  public:
+    // kNotAFrame means the byte after kFrameSync couldn't be a length, so
+    // there's no frame after all.
+    enum Result {kIncomplete, kComplete, kBadFrame, kNotAFrame};
+
+    FrameReader() : length_(0), received_(0), crc_(0) {}
+    // Call for the byte after kFrameSync, and every one after that until it
+    // returns something other than kIncomplete.
+    Result Add(uint8_t byte);
+    // The body of the frame, once Add() has returned kComplete.
+    const uint8_t* body() const {return body_;}
+    int length() const {return length_;}
+    // Get ready for the next frame.
+    void Reset() {length_ = 0; received_ = 0; crc_ = 0;}
+
+  private:
+    uint8_t body_[kMaxFrameBody];
+    int length_;
+    int received_;  // including the length
+    uint8_t crc_;
+};
+
+// The most that SendFrame() can send after |reply| and |seq|.
+const int kMaxReplyData = 33;
+
+// Sends a frame holding |reply|, |seq| (unless it's kUntagged) and |length|
+// bytes of |data|, all in one go. Safe to call from interrupt handlers.
+bool SendFrame(char reply, int seq, const uint8_t* data, int length);
+// Replies to a command: with just |reply| if |tag| is kUntagged (it was a
+// one-character command), or else with a frame echoing |tag| as the sequence
+// number.
+void SendReply(char reply, int tag);
+
+#endif  // JDH_16_17_RASPI3_FRAMES_H_
\ No newline at end of file
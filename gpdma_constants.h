@@ -0,0 +1,62 @@
+/* gpdma_constants.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+#ifndef JDH_16_17_RASPI3_GPDMA_CONSTANTS_H_
+#define JDH_16_17_RASPI3_GPDMA_CONSTANTS_H_
+
+// Datasheet: <https://www.nxp.com/documents/user_manual/UM10360.pdf>
+// See page 587 for details on the GPDMA controller. Each channel works through
+// a linked list of transfers (the first one written straight into the
+// channel's registers), moving one item per DMA request from the peripheral.
+
+// The layout of a linked list item in memory (datasheet section 31.5.5). Must
+// be word-aligned.
+struct GpdmaLink {
+    uint32_t source;
+    uint32_t destination;
+    uint32_t next;  // address of the next GpdmaLink, or 0 if this is the last
+    uint32_t control;
+};
+
+// DMACConfig (datasheet section 31.6.1.13).
+#define GPDMA_ENABLE 1<<0
+
+// DMACCxControl (datasheet section 31.6.1.19). The transfer size is counted in
+// source items and can be at most 4095; reading it back gives the number of
+// items still to go in the current link.
+#define GPDMA_CONTROL_SIZE_MASK 0xFFF
+#define GPDMA_CONTROL_MAX_SIZE 4095
+#define GPDMA_CONTROL_SWIDTH_BYTE 0<<18
+#define GPDMA_CONTROL_DWIDTH_BYTE 0<<21
+#define GPDMA_CONTROL_SWIDTH_WORD 2<<18
+#define GPDMA_CONTROL_DWIDTH_WORD 2<<21
+#define GPDMA_CONTROL_SI 1<<26  /* increment the source address */
+#define GPDMA_CONTROL_DI 1<<27  /* increment the destination address */
+#define GPDMA_CONTROL_INT 1<<31 /* terminal count interrupt at end of link */
+
+// DMACCxConfig (datasheet section 31.6.1.20).
+#define GPDMA_CONFIG_ENABLE 1<<0
+#define GPDMA_CONFIG_DEST_PERIPHERAL(n) ((n)<<6)
+#define GPDMA_CONFIG_M2P 1<<11  /* memory to peripheral */
+#define GPDMA_CONFIG_ITC 1<<15  /* don't mask the terminal count interrupt */
+#define GPDMA_CONFIG_ACTIVE 1<<17
+#define GPDMA_CONFIG_HALT 1<<18
+
+// DMA request lines (datasheet section 31.5.15). Lines 8 to 15 are shared
+// between the UARTs and the timer matches; LPC_SC->DMAREQSEL picks which.
+#define GPDMA_REQUEST_MAT2_0 12
+#define GPDMA_REQUEST_MAT2_1 13
+#define GPDMA_REQUEST_UART3_TX 14
+#define DMAREQSEL_MAT2_0 1<<4
+#define DMAREQSEL_MAT2_1 1<<5
+#define DMAREQSEL_MAT3_0 1<<6  /* clear for UART3 Tx */
+
+// Power control bit for the GPDMA in LPC_SC->PCONP.
+#define SC_PCONP_GPDMA 1<<29
+
+#endif  // JDH_16_17_RASPI3_GPDMA_CONSTANTS_H_
\ No newline at end of file
@@ -0,0 +1,122 @@
+/* gyro.cpp
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+#include "gyro.h"
+
+#include <MPU6050.h>
+
+#include "mpu6050_constants.h"
+#include "isr_profile.h"
+#include "scheduler.h"
+
+// The library sets the MPU6050 up, at its own 100 kHz...
+static MPU6050 gyro(p28, p27);
+// ...and the FIFO is read through a second interface to the same pins at
+// 400 kHz. mbed sets the bus to each I2C object's frequency as that object
+// takes it over, so the two can share it.
+static I2C gyro_bus(p28, p27);
+static InterruptIn gyro_interrupt(p29);
+
+// Samples that have arrived in the FIFO (going by the INT pulses) but haven't
+// been read yet. Only GyroDataReady adds to it, and only ReadGyro takes away
+// (with interrupts off).
+static volatile int samples_waiting = 0;
+volatile int gyro_fifo_overflows = 0;
+
+// Reads |length| consecutive bytes from the MPU6050, starting at register
+// |reg|, in one transaction.
+static void ReadRegisters(char reg, char* data, int length) {
+    gyro_bus.write(MPU6050_ADDRESS * 2, &reg, 1, true);
+    gyro_bus.read(MPU6050_ADDRESS * 2, data, length);
+}
+
+bool InitGyro() {
+    if (!gyro.testConnection()) {
+        return false;
+    }
+    gyro.write(GYRO_PWR_MGMT_1_REG, GYRO_CLKSEL_PLL_ZGYRO);
+    gyro.write(GYRO_CONFIG_REG, GYRO_DLPF_98HZ);
+    gyro.write(GYRO_GYRO_CONFIG_REG, GYRO_FS_250);
+    gyro.write(GYRO_SMPLRT_DIV_REG, 1000 / kGyroSampleRateHz - 1);
+    // Only Z goes in the FIFO, so each sample is two bytes.
+    gyro.write(GYRO_FIFO_EN_REG, GYRO_FIFO_EN_ZG);
+    // Check that it took all that, rather than trust it: one that's been
+    // browned out can answer and still be in a muddle. SMPLRT_DIV, CONFIG and
+    // GYRO_CONFIG are next to each other.
+    char settings[3];
+    gyro.read(GYRO_SMPLRT_DIV_REG, settings, 3);
+    if ((uint8_t)settings[0] != 1000 / kGyroSampleRateHz - 1
+        || (uint8_t)settings[1] != GYRO_DLPF_98HZ
+        || (uint8_t)settings[2] != (GYRO_FS_250)
+        || (uint8_t)gyro.read(GYRO_FIFO_EN_REG) != (GYRO_FIFO_EN_ZG)) {
+        return false;
+    }
+    gyro.write(GYRO_USER_CTRL_REG, GYRO_USER_CTRL_FIFO_EN | GYRO_USER_CTRL_FIFO_RESET);
+    gyro.write(GYRO_INT_PIN_CFG_REG, 0);
+    gyro_bus.frequency(400000);
+    gyro_interrupt.rise(&GyroDataReady);
+    gyro.write(GYRO_INT_ENABLE_REG, GYRO_INT_DATA_RDY_EN);
+    return true;
+}
+
+void GyroDataReady() {
+    PROFILE_ISR(kProfileGyroDataReady);
+    samples_waiting++;
+    if (samples_waiting >= kGyroBatchSamples) {
+        PostEvent(kEventGyroData);
+    }
+}
+
+int ReadGyro(int16_t* samples, int max_samples) {
+    static char bytes[2 * kGyroMaxBatchSamples];
+    if (samples_waiting < kGyroBatchSamples) {
+        return 0;
+    }
+    char count_bytes[2];
+    ReadRegisters(GYRO_FIFO_COUNTH_REG, count_bytes, 2);
+    int count = ((uint8_t)count_bytes[0] << 8) | (uint8_t)count_bytes[1];
+    if (count >= GYRO_FIFO_SIZE) {
+        // The oldest samples have been thrown away to make room, and what's
+        // left might not even start on a sample boundary, so start again.
+        gyro.write(GYRO_USER_CTRL_REG, GYRO_USER_CTRL_FIFO_EN | GYRO_USER_CTRL_FIFO_RESET);
+        __disable_irq();
+        samples_waiting = 0;
+        __enable_irq();
+        gyro_fifo_overflows++;
+        return 0;
+    }
+    int n = count / 2;
+    if (n > max_samples) {
+        n = max_samples;
+    }
+    if (n > kGyroMaxBatchSamples) {
+        n = kGyroMaxBatchSamples;
+    }
+    if (n == 0) {
+        // The count of pulses has got ahead of the FIFO somehow.
+        __disable_irq();
+        samples_waiting = 0;
+        __enable_irq();
+        return 0;
+    }
+    ReadRegisters(GYRO_FIFO_R_W_REG, bytes, 2 * n);
+    for (int i = 0; i < n; i++) {
+        samples[i] = (int16_t)(((uint8_t)bytes[2 * i] << 8) | (uint8_t)bytes[2 * i + 1]);
+    }
+    __disable_irq();
+    samples_waiting -= n;
+    if (samples_waiting < 0) {
+        samples_waiting = 0;
+    }
+    bool more = samples_waiting >= kGyroBatchSamples;
+    __enable_irq();
+    if (more) {
+        PostEvent(kEventGyroData);  // there's another batch already
+    }
+    return n;
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+/* gyro.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// The MPU6050 (on p28/p27) measures Z rotation at a fixed kGyroSampleRateHz
+// and keeps the samples in its own FIFO, pulsing its INT pin (which must be
+// wired to p29) as each one arrives. GyroDataReady counts the pulses, and once
+// a batch has built up, posts kEventGyroData (see scheduler.h) so that main()
+// can fetch the lot with ReadGyro() in one I2C burst at 400 kHz -- much less
+// bus time than asking for one reading at a time, and the samples
+// are evenly spaced however busy main() is.
+
+#ifndef JDH_16_17_RASPI3_GYRO_H_
+#define JDH_16_17_RASPI3_GYRO_H_
+
+#include "mbed.h"
+
+const int kGyroSampleRateHz = 1000;
+// Adding up the samples gives an angle, in these units.
+const int32_t kGyroUnitsPerDegree = 131 * kGyroSampleRateHz;
+// ReadGyro() waits until at least this many samples are in the FIFO. More
+// means fewer transactions but staler data: 8 is 8 ms' worth.
+const int kGyroBatchSamples = 8;
+// The most samples ReadGyro() will return at once (128 bytes, about 3 ms of
+// bus time). The FIFO holds 512, so anything left waits for the next call.
+const int kGyroMaxBatchSamples = 64;
+
+// Sets the sample rate and starts the FIFO and interrupt. Returns false if the
+// MPU6050 didn't answer, or didn't keep the settings it was given.
+bool InitGyro();
+// Attached to the rising edge of p29 by InitGyro().
+void GyroDataReady();
+// Call from main(). Copies any waiting samples (raw Z rates, 131 per degree/s)
+// into |samples|, oldest first, and returns how many there were -- 0 if there
+// isn't a full batch yet. If there's still a batch left after that, it posts
+// kEventGyroData again.
+int ReadGyro(int16_t* samples, int max_samples);
+
+// Times the FIFO filled up before it was read, losing samples.
+extern volatile int gyro_fifo_overflows;
+
+#endif  // JDH_16_17_RASPI3_GYRO_H_
\ No newline at end of file
@@ -0,0 +1,54 @@
+/* gyro_bias.cpp
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+#include "gyro_bias.h"
+
+static const int kFractionBits = 8;
+
+// It starts out still, so there's nothing to wait for.
+GyroBias::GyroBias()
+        : still_for_(kGyroBiasSettleSamples), count_(0), sum_(0), bias_(0), residual_(0) {}
+
+void GyroBias::Learn(int32_t scaled) {
+    if (count_ < kGyroBiasStartSamples) {
+        sum_ += scaled;
+        count_++;
+        bias_ = (int32_t)(sum_ / count_);
+        if (count_ == kGyroBiasStartSamples) {
+            sum_ = (int64_t)bias_ << kGyroBiasShift;  // carry on from here
+        }
+        return;
+    }
+    int32_t difference = scaled - bias_;
+    if (difference > (kGyroBiasGate << kFractionBits)
+        || difference < -(kGyroBiasGate << kFractionBits)) {
+        return;
+    }
+    sum_ += difference;
+    bias_ = (int32_t)(sum_ >> kGyroBiasShift);
+}
+
+int16_t GyroBias::Update(int16_t raw, bool still) {
+    int32_t scaled = (int32_t)raw << kFractionBits;
+    if (!still) {
+        still_for_ = 0;
+    } else if (still_for_ < kGyroBiasSettleSamples) {
+        still_for_++;
+    } else {
+        Learn(scaled);
+    }
+    residual_ += scaled - bias_;
+    int32_t corrected = residual_ >> kFractionBits;
+    residual_ -= corrected << kFractionBits;
+    if (corrected > 32767) {
+        corrected = 32767;
+    } else if (corrected < -32768) {
+        corrected = -32768;
+    }
+    return (int16_t)corrected;
+}
\ No newline at end of file
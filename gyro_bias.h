@@ -0,0 +1,59 @@
+/* gyro_bias.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// Takes the MPU6050's zero-rate offset out of its Z samples. Standing still,
+// the gyro doesn't read 0 but a few tens of raw units either way, and that
+// creeps as the chip warms up. Left in, it sets how wide the collision
+// detectors' thresholds have to be (rather than anything a collision does),
+// and it adds up in yaw, a degree or so a minute.
+//
+// GyroBias learns the offset from the samples taken whilst the robot isn't
+// moving: the plain mean of the first kGyroBiasStartSamples, and after that an
+// exponential moving average with a time constant of 2^kGyroBiasShift
+// samples, which is slow enough to ignore noise and quick enough to follow
+// thermal drift. The first kGyroBiasSettleSamples after the robot stops are
+// left out, since it may still be rocking, and so is any sample more than
+// kGyroBiasGate from the offset once it's known (somebody has picked the
+// robot up, say).
+//
+// The offset is kept to 1/256 of a raw unit. Each corrected sample carries
+// its rounding error on to the next, so adding them up (as yaw does) loses
+// nothing to the fraction.
+
+#ifndef JDH_16_17_RASPI3_GYRO_BIAS_H_
+#define JDH_16_17_RASPI3_GYRO_BIAS_H_
+
+#include <stdint.h>
+
+const int kGyroBiasStartSamples = 256;  // 256 ms
+const int kGyroBiasShift = 11;  // about 2 s
+const int kGyroBiasSettleSamples = 100;
+const int kGyroBiasGate = 131;  // 1 degree/s, in raw units
+
+class GyroBias {
+  public:
+    GyroBias();
+    // Takes the next raw sample, learning from it if the robot is |still|,
+    // and returns it with the offset taken out.
+    int16_t Update(int16_t raw, bool still);
+    // The offset, in 1/256ths of a raw unit.
+    int32_t bias() const {return bias_;}
+    // Whether kGyroBiasStartSamples have been learnt from yet. Until then the
+    // offset is the mean of however many there have been (0 for none).
+    bool settled() const {return count_ >= kGyroBiasStartSamples;}
+  private:
+    void Learn(int32_t scaled);
+
+    int still_for_;
+    int count_;
+    int64_t sum_;  // of the first samples, and then the offset times 2^kGyroBiasShift
+    int32_t bias_;
+    int32_t residual_;  // rounding error carried forward
+};
+
+#endif  // JDH_16_17_RASPI3_GYRO_BIAS_H_
\ No newline at end of file
@@ -0,0 +1,33 @@
+/* MPU6050.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// Stand-in for the MPU6050 library (see MPU6050.lib) in the host build. Like
+// the real one, it talks to the chip (modelled in sim.cpp, with its Z rate
+// from whatever source the bench installs with sim::SetGyroSource()) through
+// its own I2C object at the default 100 kHz.
+
+#ifndef JDH_16_17_RASPI3_HOST_MPU6050_H_
+#define JDH_16_17_RASPI3_HOST_MPU6050_H_
+
+#include "mbed.h"
+
+// AD0 high.
+#define MPU6050_ADDRESS 0x69
+
+class MPU6050 {
+  public:
+    MPU6050(PinName sda, PinName scl);
+    bool testConnection();
+    void write(char address, char data);
+    char read(char address);
+    void read(char address, char* data, int length);
+  private:
+    I2C connection;
+};
+
+#endif  // JDH_16_17_RASPI3_HOST_MPU6050_H_
\ No newline at end of file
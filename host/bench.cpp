@@ -0,0 +1,889 @@
+/* bench.cpp
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// Runs the unmodified firmware on the virtual clock (see sim.h), playing the
+// part of the Pi: each command is sent over the USB serial connection, and the
+// next one isn't sent until the reply to the last one has come back, just as
+// the Pi does. At the end, it prints how long each move took, how fast the
+// steps came, and how much of the CPU the interrupt handlers used.
+//
+// Usage: bench [-v battery] [-g sag] [-d dip] [-s start_ms] [-t timeout_ms]
+//              [-q depth] [-k turn_factor] [-j knock_ms] [-n noise_ms]
+//              [-z offset] [-T file] [-F file] [-b] [-r] [command...]
+//     -v  motor board voltage as seen on p15, as a fraction (default 0.8)
+//     -g  how far that drops whilst the motors are stepping (default 0)
+//     -d  DIP switch value (default 0)
+//     -s  when the Pi sends its first command, in ms after reset, whether the
+//         robot is ready or not (by default, the Pi waits for kReadyByte)
+//     -t  how long to wait for each reply, in ms (default 60000)
+//     -q  how many commands the Pi sends before waiting for replies (default 1);
+//         's', 't' and 'v' are answered straight away, so with more than one
+//         outstanding their replies get matched to the wrong commands (but
+//         see -b)
+//     -k  how far the robot really turns for each degree it's told to, to
+//         stand in for wheel slip and a badly-measured robot diameter
+//         (default 1)
+//     -j  knock the robot round by a few degrees this many ms after reset, as
+//         a collision would; it should stop and reply 'e', and a 'c' after
+//         that carries on with the rest of the move
+//     -n  line noise this many ms after reset: a stray kFrameSync and a byte
+//         that could be a frame's length, which the robot should forget by
+//         the time the next command comes (see frames.h)
+//     -z  what the gyro reads when the robot is still, in degrees/s (default
+//         0); the firmware should learn it and take it out (see gyro_bias.h)
+//     -T  write what comes out of p9 (the telemetry; see telemetry.h) to
+//         |file|, for host/telemetry_csv
+//     -F  load the last sector of flash (where the calibration is kept; see
+//         calibration.h) from |file| if it's there, and save it back at the
+//         end, so that one run can pick up where another left off
+//     -b  use the framed protocol (see frames.h): the commands the Pi can
+//         send at once go in one frame, and replies are matched to commands
+//         by their sequence numbers
+//     -r  only print what should come out the same every time the firmware
+//         does the same thing: the steps, peak speed, turn and reply for each
+//         command, the answers, and anything lost (see check in the Makefile)
+// Commands are the command letter followed by its argument, e.g. f50 l90 F20,
+// or by both of them for an arc: L90,30 is 90 degrees to the left with a
+// radius of 30 cm (only bench_arc can do those). With -b, arguments can have
+// fractions, down to a millimetre or a hundredth of a degree (f12.3 l22.5),
+// and p and h (followed by a ProfiledHandler number) ask for the interrupt
+// handlers' own timings (see isr_profile.h), v for the battery level (see
+// battery.h), and m (followed by a period in ms) changes how often telemetry
+// frames are sent (see telemetry.h); w asks where the robot thinks it is, and
+// o (followed by a period in ms) has it say so every so often whilst moving
+// (see pose.h), which is shown against where the bench's robot really is; k
+// (followed by a mode) asks for, measures or forgets the calibration, and d
+// (followed by the mm the robot was told to go and the mm it went, e.g.
+// d500,490) corrects its steps per centimetre (see calibration.h). The
+// answers are shown after the table. Only bench has ISR_PROFILING turned on.
+// With no commands, a short route is run. The gyro sees the robot turn as the
+// wheels (and -k and -j) say it does, plus -z.
+//
+// The Makefile builds it four times: bench counts steps with TIMER2,
+// bench_mr4 with a PWM match 4 interrupt per step (see STEP_COUNTER_TIMER),
+// and bench_dma also has the step periods loaded by DMA (see STEP_PERIOD_DMA),
+// so the interrupt rates of them can be compared. bench_arc is bench with a
+// clock for each wheel (see SEPARATE_STEP_CLOCKS); where the wheels take
+// different numbers of steps, they're shown as left/right.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "mbed.h"
+#include "sim.h"
+
+#include "robot_specific.h"
+#include "interrupt_handlers.h"
+#include "serial_tx.h"
+#include "frames.h"
+#include "gyro.h"
+#include "isr_profile.h"
+#include "battery.h"
+#include "pose.h"
+#include "calibration.h"
+#include "commands.h"
+
+int firmware_main();  // main() in main.cpp, renamed by the Makefile
+
+namespace {
+
+struct Move {
+    char command;
+    double argument;  // -1 if the command doesn't take one
+    double argument2;  // an arc's radius, or -1
+    uint64_t started;
+    uint64_t finished;
+    uint64_t steps;  // taken by the left wheel
+    uint64_t right_steps;
+    uint64_t shortest_step;
+    int reply;  // -1 if it never came
+    int answer;  // to 's' or 't' with -b
+    uint8_t data[kMaxFrameBody];  // the rest of a reply frame, with -b
+    int data_length;
+    double turned;  // degrees, anticlockwise
+};
+
+struct HandlerName {
+    void (*handler)();
+    const char* name;
+    bool counts_steps;  // runs because of steps, rather than time or serial
+};
+
+const HandlerName kHandlers[] = {
+    {PwmHandler, "PwmHandler", true},
+#if STEP_COUNTER_TIMER && !STEP_PERIOD_DMA
+    {StepCounterHandler, "StepCounterHandler", true},
+#endif
+#if STEP_PERIOD_DMA
+    {StepStreamHandler, "StepStreamHandler", true},
+#endif
+    {ScaleSpeed, "ScaleSpeed", false},
+    {SerialHandler, "SerialHandler", false},
+    {SerialTxHandler, "SerialTxHandler", false},
+    {GyroDataReady, "GyroDataReady", false},
+    {BatteryHandler, "BatteryHandler", false},
+};
+const int kHandlerCount = sizeof(kHandlers) / sizeof(kHandlers[0]);
+
+const char* const kDefaultRoute[] = {"f30", "l90", "f100", "r45", "F20", "b50", "r135"};
+
+int ArgumentCount(char command) {
+    switch (command) {
+        case 's': case 'c': case 't': case 'v': case 'w':
+            return 0;
+        case 'L': case 'R': case 'd':
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+bool framed = false;  // -b
+bool results_only = false;  // -r
+
+// What a command's arguments are multiplied by to go in a frame: centimetres
+// (tens of them for 'F') to millimetres, or degrees to hundredths.
+double FrameScale(char command, int which) {
+    switch (command) {
+        case 'p': case 'h': case 'm': case 'o': case 'k': case 'd':
+            return 1;
+        case 'F':
+            return 100;
+        case 'l': case 'r':
+            return 100;
+        case 'L': case 'R':
+            return which == 0 ? 100 : 10;
+        default:
+            return 10;
+    }
+}
+
+uint8_t FrameOpcodeFor(char command) {
+    switch (command) {
+        case 'f': case 'F': return kOpForward;
+        case 'A': return kOpForwardLowPower;
+        case 'b': return kOpBackward;
+        case 'l': return kOpLeft;
+        case 'r': return kOpRight;
+        case 'L': return kOpArcLeft;
+        case 'R': return kOpArcRight;
+        case 'c': return kOpContinue;
+        case 's': return kOpDipSwitch;
+        case 't': return kOpTurnError;
+        case 'p': return kOpIsrProfile;
+        case 'h': return kOpIsrHistogram;
+        case 'v': return kOpBattery;
+        case 'm': return kOpTelemetry;
+        case 'w': return kOpPose;
+        case 'o': return kOpPosePeriod;
+        case 'k': return kOpCalibrate;
+        case 'd': return kOpCalibrateDistance;
+        default: return 0xff;  // the robot should say '?'
+    }
+}
+
+// Adds |move| to the body of a frame as a request with sequence number |seq|.
+void AddRequest(const Move& move, uint8_t seq, std::vector<uint8_t>* body) {
+    body->push_back(FrameOpcodeFor(move.command));
+    body->push_back(seq);
+    for (int i = 0; i < ArgumentCount(move.command); i++) {
+        double value = i == 0 ? move.argument : move.argument2;
+        int scaled = (int)floor(value * FrameScale(move.command, i) + 0.5);
+        body->push_back((uint8_t)scaled);
+        if (move.command != 'p' && move.command != 'h' && move.command != 'k') {
+            body->push_back((uint8_t)(scaled >> 8));
+        }
+    }
+}
+
+// The steps each wheel has taken.
+uint64_t LeftSteps() {return sim::StepCount();}
+uint64_t RightSteps() {
+#if SEPARATE_STEP_CLOCKS
+    return sim::RightStepCount();
+#else
+    return sim::StepCount();
+#endif
+}
+
+// The robot as its gyro sees it: half the difference between the wheels'
+// steps, each way, turns it by turn_factor / kDefaultStepsPerDegree (which is
+// Q16.16), whatever the calibration says.
+double turn_factor = 1.0;
+double heading = 0.0;  // degrees, anticlockwise
+// Where the middle of the robot really is, in mm from where it started: x
+// forwards, y to the left.
+double robot_x = 0.0;
+double robot_y = 0.0;
+uint64_t gyro_left = 0;
+uint64_t gyro_right = 0;
+uint64_t gyro_time = 0;
+// -j: when the knock starts (0 for none). It turns the robot at kKnockRate
+// degrees/s for kKnockMs, on top of what the wheels do.
+uint64_t knock_at = 0;
+const double kKnockRate = 30.0;
+const double kKnockMs = 100.0;
+double gyro_offset = 0.0;  // -z, degrees/s
+
+// How far the knock turns the robot between |from| and |to|, in degrees.
+double Knock(uint64_t from, uint64_t to) {
+    if (knock_at == 0) {
+        return 0.0;
+    }
+    uint64_t end = knock_at + sim::FromMicroseconds((uint64_t)(kKnockMs * 1000));
+    uint64_t start = from > knock_at ? from : knock_at;
+    uint64_t stop = to < end ? to : end;
+    return stop > start ? kKnockRate * sim::ToSeconds(stop - start) : 0.0;
+}
+
+int RobotGyro(uint64_t when) {
+    uint64_t left = LeftSteps();
+    uint64_t right = RightSteps();
+    // LeftWheelForward() and RightWheelForward() in robot_specific.cpp.
+    double left_moved = (double)(left - gyro_left) * (sim::PinValue(p17) == 0 ? 1 : -1);
+    double right_moved = (double)(right - gyro_right) * (sim::PinValue(p16) == 1 ? 1 : -1);
+    double degrees = (right_moved - left_moved) / 2 * turn_factor * 65536.0 / kDefaultStepsPerDegree;
+    degrees += Knock(gyro_time, when);
+    double seconds = sim::ToSeconds(when - gyro_time);
+    gyro_left = left;
+    gyro_right = right;
+    gyro_time = when;
+    double millimetres = (left_moved + right_moved) / 2 * 10 * 65536.0 / kDefaultStepsPerCentimetre;
+    double middle = (heading + degrees / 2) * M_PI / 180;
+    robot_x += millimetres * cos(middle);
+    robot_y += millimetres * sin(middle);
+    heading += degrees;
+    if (seconds <= 0) {
+        return (int)floor(131.0 * gyro_offset + 0.5);
+    }
+    return (int)floor(kGyroLeftTurnSign * 131.0 * degrees / seconds + 131.0 * gyro_offset + 0.5);
+}
+
+// The Pi end of the USB serial connection. It keeps up to |depth| commands
+// outstanding; replies are matched to commands in the order they were sent,
+// or by sequence number with -b.
+class Pi : public sim::EventSource {
+  public:
+    // |start| is sim::kNever to wait for kReadyByte.
+    Pi(std::vector<Move>* moves, uint64_t start, uint64_t timeout, size_t depth)
+        : moves_(moves), depth_(depth), sending_(0), finishing_(0),
+          next_byte_(0), arrival_(start), timeout_(timeout), run_start_(0),
+          isr_at_start_(0), ready_at_(0), batch_(0), in_frame_(false),
+          bad_replies_(0), pushed_poses_(0) {
+        stats_at_start_.resize(kHandlerCount);
+        replies_.resize(moves->size(), -1);
+        if (arrival_ != sim::kNever) {
+            // The first byte finishes arriving one character time after it's
+            // sent.
+            arrival_ += sim::ByteCycles(0);
+        }
+    }
+
+    uint64_t NextEvent() {
+        uint64_t next = sim::kNever;
+        if (CanSend()) {
+            next = arrival_;
+        }
+        if (sending_ == 0 && next == sim::kNever) {
+            next = timeout_;  // for the robot to say it's ready
+        }
+        if (finishing_ < sending_) {
+            uint64_t deadline = (*moves_)[finishing_].started + timeout_;
+            if (deadline < next) {
+                next = deadline;
+            }
+        }
+        return next;
+    }
+
+    void Fire(uint64_t when) {
+        if (arrival_ == sim::kNever) {
+            throw sim::Finished();  // it never said it was ready
+        }
+        if (finishing_ < sending_
+            && when >= (*moves_)[finishing_].started + timeout_) {
+            Finish(when, -1);  // timed out
+            return;
+        }
+        Move& move = (*moves_)[sending_];
+        if (sending_ == 0 && next_byte_ == 0) {
+            run_start_ = when;
+            isr_at_start_ = sim::IsrCycles();
+            for (int i = 0; i < kHandlerCount; i++) {
+                const sim::HandlerStats* s = sim::StatsFor(kHandlers[i].handler);
+                stats_at_start_[i] = s ? *s : sim::HandlerStats();
+            }
+        }
+        arrival_ = when + sim::ByteCycles(0);
+        if (framed) {
+            if (next_byte_ == 0) {
+                BuildFrame();
+            }
+            sim::Receive(0, frame_[next_byte_++]);
+            if (next_byte_ < (int)frame_.size()) {
+                return;
+            }
+            next_byte_ = 0;
+            for (size_t i = 0; i < batch_; i++) {
+                Sent(when);
+            }
+            return;
+        }
+        if (next_byte_ == 0) {
+            sim::Receive(0, move.command);
+        } else {
+            sim::Receive(0, (uint8_t)(next_byte_ == 1 ? move.argument : move.argument2));
+        }
+        if (next_byte_ < ArgumentCount(move.command)) {
+            next_byte_++;
+            return;
+        }
+        next_byte_ = 0;
+        Sent(when);
+    }
+
+    void Reply(uint8_t byte, uint64_t when) {
+        if (ready_at_ == 0 && byte == (uint8_t)kReadyByte) {
+            // Always the first thing it sends.
+            ready_at_ = when;
+            if (arrival_ == sim::kNever) {
+                arrival_ = when + sim::ByteCycles(0);
+            }
+            return;
+        }
+        if (!framed) {
+            if (finishing_ < sending_) {
+                Finish(when, byte);
+            }
+            return;
+        }
+        if (!in_frame_) {
+            in_frame_ = byte == kFrameSync;
+            bad_replies_ += !in_frame_;
+            return;
+        }
+        FrameReader::Result result = reader_.Add(byte);
+        if (result == FrameReader::kIncomplete) {
+            return;
+        }
+        in_frame_ = false;
+        if (result != FrameReader::kComplete || reader_.length() < 2) {
+            bad_replies_++;  // including '!' and '?', which have no sequence number
+            return;
+        }
+        const uint8_t* body = reader_.body();
+        if (body[0] == 'W' && reader_.length() == 1 + kPoseData) {
+            pushed_poses_++;  // sent of its own accord, so no sequence number
+            memcpy(last_pushed_, body + 1, kPoseData);
+            return;
+        }
+        size_t i = finishing_;
+        while (i < sending_ && (i & 0xff) != body[1]) {
+            i++;
+        }
+        if (i == sending_) {
+            bad_replies_++;
+            return;
+        }
+        // Queries are answered straight away, maybe before moves ahead of
+        // them have finished; they're counted as finishing after those moves.
+        replies_[i] = body[0];
+        Move& move = (*moves_)[i];
+        move.data_length = reader_.length() - 2;
+        memcpy(move.data, body + 2, move.data_length);
+        if (reader_.length() == 3) {
+            (*moves_)[i].answer = body[2];
+        } else if (reader_.length() >= 4) {
+            (*moves_)[i].answer = (int16_t)(body[2] | body[3] << 8);
+        }
+        while (finishing_ < sending_ && replies_[finishing_] >= 0) {
+            Finish(when, replies_[finishing_]);
+        }
+    }
+
+    uint64_t run_start() const {return run_start_;}
+    uint64_t isr_at_start() const {return isr_at_start_;}
+    uint64_t ready_at() const {return ready_at_;}
+    const sim::HandlerStats& stats_at_start(int i) const {return stats_at_start_[i];}
+    int bad_replies() const {return bad_replies_;}
+    int pushed_poses() const {return pushed_poses_;}
+    const uint8_t* last_pushed() const {return last_pushed_;}
+
+  private:
+    bool CanSend() {
+        return sending_ < moves_->size() && sending_ - finishing_ < depth_;
+    }
+
+    // Puts as many moves as can be outstanding into the next frame.
+    void BuildFrame() {
+        std::vector<uint8_t> body;
+        batch_ = 0;
+        while (sending_ + batch_ < moves_->size()
+               && sending_ + batch_ - finishing_ < depth_
+               && body.size() + 6 <= (size_t)kMaxFrameBody) {
+            AddRequest((*moves_)[sending_ + batch_], (uint8_t)(sending_ + batch_), &body);
+            batch_++;
+        }
+        frame_.clear();
+        frame_.push_back(kFrameSync);
+        frame_.push_back((uint8_t)body.size());
+        frame_.insert(frame_.end(), body.begin(), body.end());
+        uint8_t crc = 0;
+        for (size_t i = 1; i < frame_.size(); i++) {
+            crc = Crc8(crc, frame_[i]);
+        }
+        frame_.push_back(crc);
+    }
+
+    // The move at |sending_| has finished arriving.
+    void Sent(uint64_t when) {
+        (*moves_)[sending_].started = when;
+        if (sending_ == finishing_) {
+            Activate(when);
+        }
+        sending_++;
+    }
+
+    // The move at the front starts being carried out (as far as the Pi can
+    // tell) once it has arrived and everything before it has finished.
+    void Activate(uint64_t when) {
+        active_since_ = when;
+        heading_at_start_ = heading;
+        steps_at_start_ = LeftSteps();
+        right_steps_at_start_ = RightSteps();
+        sim::ResetStepPeriod();
+    }
+
+    void Finish(uint64_t when, int reply) {
+        Move& move = (*moves_)[finishing_];
+        move.started = active_since_;
+        move.finished = when;
+        move.reply = reply;
+        move.steps = LeftSteps() - steps_at_start_;
+        move.right_steps = RightSteps() - right_steps_at_start_;
+        move.turned = heading - heading_at_start_;
+        move.shortest_step = sim::ShortestStepPeriod();
+        finishing_++;
+        if (finishing_ >= moves_->size()) {
+            throw sim::Finished();
+        }
+        if (finishing_ < sending_) {
+            Activate(when);
+        }
+        if (arrival_ < when + sim::ByteCycles(0) && next_byte_ == 0) {
+            arrival_ = when + sim::ByteCycles(0);  // the Pi reacts to the reply
+        }
+    }
+
+    std::vector<Move>* moves_;
+    size_t depth_;
+    size_t sending_;    // index of the move being sent
+    size_t finishing_;  // index of the move whose reply is awaited
+    int next_byte_;
+    uint64_t arrival_;
+    uint64_t timeout_;
+    uint64_t active_since_;
+    uint64_t steps_at_start_;
+    uint64_t right_steps_at_start_;
+    double heading_at_start_;
+    uint64_t run_start_;
+    uint64_t isr_at_start_;
+    uint64_t ready_at_;  // 0 until kReadyByte comes
+    std::vector<sim::HandlerStats> stats_at_start_;
+    // With -b.
+    std::vector<uint8_t> frame_;  // being sent
+    size_t batch_;  // moves in it
+    std::vector<int> replies_;  // come back before the moves ahead of them
+    FrameReader reader_;
+    bool in_frame_;
+    int bad_replies_;
+    int pushed_poses_;
+    uint8_t last_pushed_[kPoseData];
+};
+
+Pi* pi = NULL;
+FILE* telemetry = NULL;
+
+// -n: two bytes that the Pi never sent.
+class Noise : public sim::EventSource {
+  public:
+    explicit Noise(uint64_t at) : at_(at) {}
+    uint64_t NextEvent() {return at_;}
+    void Fire(uint64_t) {
+        sim::Receive(0, kFrameSync);
+        sim::Receive(0, 10);
+        at_ = sim::kNever;
+    }
+
+  private:
+    uint64_t at_;
+};
+
+void OnTx(int uart, uint8_t byte, uint64_t when) {
+    if (uart == 0 && pi) {
+        pi->Reply(byte, when);
+    } else if (uart == 3 && telemetry) {
+        fputc(byte, telemetry);
+    }
+}
+
+bool ParseMove(const char* arg, Move* move) {
+    memset(move, 0, sizeof(*move));
+    move->command = arg[0];
+    move->argument = -1;
+    move->argument2 = -1;
+    if ((move->command == 'v' || move->command == 'm' || move->command == 'w'
+         || move->command == 'o' || move->command == 'k' || move->command == 'd')
+        && !framed) {
+        return false;
+    }
+    int count = ArgumentCount(move->command);
+    const char* next = arg + 1;
+    for (int i = 0; i < count; i++) {
+        char* end;
+        double value = strtod(next, &end);
+        if (end == next || value < 0) {
+            return false;
+        }
+        if ((move->command == 'p' || move->command == 'h' || move->command == 'k')
+            && (!framed || value > 255)) {
+            return false;
+        }
+        if (framed ? floor(value * FrameScale(move->command, i) + 0.5) > 65535
+                   : value > 255 || value != floor(value)) {
+            return false;
+        }
+        *(i == 0 ? &move->argument : &move->argument2) = value;
+        next = end;
+        if (i + 1 < count) {
+            if (*next != ',') {
+                return false;
+            }
+            next++;
+        }
+    }
+    return *next == '\0';
+}
+
+void Usage() {
+    fprintf(stderr, "usage: bench [-v battery] [-g sag] [-d dip] [-s start_ms] "
+                    "[-t timeout_ms] [-q depth] [-k turn_factor] [-j knock_ms] "
+                    "[-n noise_ms] [-z offset] "
+                    "[-T file] [-F file] [-b] [-r] "
+                    "[command...]\n");
+    exit(2);
+}
+
+uint32_t Read32(const uint8_t* bytes) {
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+void PrintPose(const char* what, const uint8_t* data) {
+    printf("%s: %d, %d mm, facing %+.2f degrees, wheels %d/%d steps, at %.3f s\n", what,
+           (int32_t)Read32(data), (int32_t)Read32(data + 4),
+           (int16_t)(data[8] | data[9] << 8) / 100.0, (int32_t)Read32(data + 10),
+           (int32_t)Read32(data + 14), Read32(data + 18) / 1e6);
+}
+
+// Decodes the replies to p, h, v, m, w, o, k and d, as the Pi would.
+void ReportAnswers(const std::vector<Move>& moves) {
+    bool pose = false;
+    for (size_t i = 0; i < moves.size(); i++) {
+        const Move& move = moves[i];
+        const uint8_t* data = move.data;
+        if (move.reply == 'p' && move.data_length == 25) {
+            printf("handler %d: %u calls, %u/%u/%u cycles shortest/mean/longest, "
+                   "%u to %u cycles apart\n", data[0], Read32(data + 1), Read32(data + 5),
+                   Read32(data + 13), Read32(data + 9), Read32(data + 17), Read32(data + 21));
+        } else if (move.reply == 'h' && move.data_length == 33) {
+            printf("handler %d, calls by cycles taken:", data[0]);
+            for (int bin = 0; bin < kIsrHistogramBins; bin++) {
+                int count = data[1 + 2 * bin] | data[2 + 2 * bin] << 8;
+                if (count) {
+                    printf(" %u+:%d", 1u << bin, count);
+                }
+            }
+            printf("\n");
+        } else if (move.reply == 'v' && move.data_length == 8) {
+            printf("battery: %.3f, sagging by %.3f, at %.3f s\n",
+                   (data[0] | data[1] << 8) / 65535.0, (data[2] | data[3] << 8) / 65535.0,
+                   Read32(data + 4) / 1e6);
+        } else if (move.reply == 'm' && move.data_length == 4) {
+            printf("telemetry: %u frames dropped so far\n", Read32(data));
+        } else if (move.reply == 'w' && move.data_length == kPoseData) {
+            PrintPose("pose", data);
+            pose = true;
+        } else if (move.reply == 'k' && move.data_length == kCalibrationData) {
+            printf("calibration: %.4f steps/cm, %.4f steps/degree, veering %+.2f degrees/m, %s\n",
+                   Read32(data) / 65536.0, Read32(data + 4) / 65536.0,
+                   (int16_t)(data[8] | data[9] << 8) / 100.0,
+                   data[10] ? "saved" : "the defaults");
+        }
+    }
+    if (pi->pushed_poses() > 0) {
+        char what[32];
+        snprintf(what, sizeof(what), "%d pushed, the last", pi->pushed_poses());
+        PrintPose(what, pi->last_pushed());
+    }
+    if (pose) {
+        // Facing from -180 to 180, as in pose.h.
+        double facing = heading - 360 * floor((heading + 180) / 360);
+        printf("the robot is really at %.0f, %.0f mm, facing %+.2f degrees\n",
+               robot_x, robot_y, facing);
+    }
+}
+
+// How Report() and ReportResults() show a move's reply, argument and steps.
+void FormatReply(const Move& move, char* reply, size_t size) {
+    if (move.reply < 0) {
+        snprintf(reply, size, "none");
+    } else if (move.command == 't' && framed) {
+        snprintf(reply, size, "%+.2f", move.answer / 100.0);
+    } else if (move.command == 't') {
+        // Tenths of a degree.
+        snprintf(reply, size, "%+.1f", (int8_t)move.reply / 10.0);
+    } else if (move.command == 's' && framed) {
+        snprintf(reply, size, "%d", move.answer);
+    } else if (move.reply >= 0x20 && move.reply < 0x7f) {
+        snprintf(reply, size, "'%c'", move.reply);
+    } else {
+        snprintf(reply, size, "0x%02x", move.reply);
+    }
+}
+
+void FormatArgument(const Move& move, char* argument, size_t size) {
+    if (move.argument2 >= 0) {
+        snprintf(argument, size, "%g,%g", move.argument, move.argument2);
+    } else {
+        snprintf(argument, size, "%g", move.argument);
+    }
+}
+
+void FormatSteps(const Move& move, char* steps, size_t size) {
+    if (move.right_steps != move.steps) {
+        snprintf(steps, size, "%llu/%llu", (unsigned long long)move.steps,
+                 (unsigned long long)move.right_steps);
+    } else {
+        snprintf(steps, size, "%llu", (unsigned long long)move.steps);
+    }
+}
+
+double PeakStepRate(const Move& move) {
+    return move.shortest_step == sim::kNever ? 0.0 : 1.0 / sim::ToSeconds(move.shortest_step);
+}
+
+// What -r prints: none of the timings, which change whenever the firmware's
+// speed does, only what the robot did.
+void ReportResults(const std::vector<Move>& moves) {
+    for (size_t i = 0; i < moves.size(); i++) {
+        const Move& move = moves[i];
+        char reply[8];
+        FormatReply(move, reply, sizeof(reply));
+        char argument[24];
+        FormatArgument(move, argument, sizeof(argument));
+        char steps[24];
+        FormatSteps(move, steps, sizeof(steps));
+        printf("%c %s: %s steps, peak %.0f steps/s, turned %.2f, reply %s\n",
+               move.command, argument, steps, PeakStepRate(move), move.turned, reply);
+    }
+    ReportAnswers(moves);
+    printf("lost step interrupts %llu, serial bytes lost %llu/%d, dropped %d",
+           (unsigned long long)sim::LostStepInterrupts(),
+           (unsigned long long)sim::RxOverruns(), (int)serial_rx_dropped,
+           (int)serial_tx_dropped);
+    if (framed) {
+        printf(", bad reply frames %d", pi->bad_replies());
+    }
+    printf("\n%s\n", pi->ready_at() ? "ready" : "never ready");
+}
+
+void Report(const std::vector<Move>& moves) {
+    if (results_only) {
+        ReportResults(moves);
+        return;
+    }
+    printf("%-4s %5s %8s %10s %10s %14s %8s %6s\n",
+           "cmd", "arg", "steps", "time/ms", "steps/s", "peak steps/s", "turned", "reply");
+    for (size_t i = 0; i < moves.size(); i++) {
+        const Move& move = moves[i];
+        char reply[8];
+        FormatReply(move, reply, sizeof(reply));
+        double seconds = sim::ToSeconds(move.finished - move.started);
+        double peak = PeakStepRate(move);
+        char argument[24];
+        FormatArgument(move, argument, sizeof(argument));
+        uint64_t outer = move.steps > move.right_steps ? move.steps : move.right_steps;
+        char steps[24];
+        FormatSteps(move, steps, sizeof(steps));
+        printf("%-4c %5s %8s %10.1f %10.0f %14.0f %8.2f %6s\n",
+               move.command, argument, steps,
+               seconds * 1000.0, seconds > 0 ? outer / seconds : 0.0,
+               peak, move.turned, reply);
+    }
+
+    ReportAnswers(moves);
+
+    uint64_t elapsed = sim::Now() - pi->run_start();
+    printf("\nrun time %.3f s, ISR occupancy %.2f%%, lost step interrupts %llu\n",
+           sim::ToSeconds(elapsed),
+           100.0 * (sim::IsrCycles() - pi->isr_at_start()) / elapsed,
+           (unsigned long long)sim::LostStepInterrupts());
+    if (pi->ready_at()) {
+        printf("ready %.1f ms after reset\n", sim::ToSeconds(pi->ready_at()) * 1000.0);
+    } else {
+        printf("the robot never said it was ready\n");
+    }
+    printf("serial bytes lost: %llu in the UART FIFO, %d in serial_rx\n",
+           (unsigned long long)sim::RxOverruns(), (int)serial_rx_dropped);
+    printf("serial_tx high-water mark %u of %u, bytes dropped %d\n",
+           SerialTxHighWater(), kSerialTxBufferSize, (int)serial_tx_dropped);
+    if (framed) {
+        printf("reply frames that were bad or unexpected: %d\n", pi->bad_replies());
+    }
+    printf("gyro: %llu samples, %llu lost in its FIFO (%d overflows), I2C busy %.2f%%\n",
+           (unsigned long long)sim::GyroSamples(), (unsigned long long)sim::GyroFifoLost(),
+           (int)gyro_fifo_overflows, 100.0 * sim::I2cBusyCycles() / sim::Now());
+    printf("%-18s %10s %10s %10s %8s\n", "handler", "calls", "mean/us", "max/us", "share");
+    uint64_t step_calls = 0;
+    for (int i = 0; i < kHandlerCount; i++) {
+        const sim::HandlerStats* s = sim::StatsFor(kHandlers[i].handler);
+        if (!s) {
+            continue;
+        }
+        const sim::HandlerStats& before = pi->stats_at_start(i);
+        uint64_t calls = s->calls - before.calls;
+        uint64_t cycles = s->cycles - before.cycles;
+        printf("%-18s %10llu %10.2f %10.2f %7.2f%%\n", kHandlers[i].name,
+               (unsigned long long)calls,
+               calls ? sim::ToSeconds(cycles) * 1e6 / calls : 0.0,
+               sim::ToSeconds(s->max_cycles) * 1e6,
+               100.0 * cycles / elapsed);
+        if (kHandlers[i].counts_steps) {
+            step_calls += calls;
+        }
+    }
+    uint64_t steps = 0;
+    for (size_t i = 0; i < moves.size(); i++) {
+        steps += moves[i].steps;
+    }
+    printf("step interrupts (%s): %llu for %llu steps, %.3f per step\n",
+           STEP_PERIOD_DMA ? "DMA" : STEP_COUNTER_TIMER ? "TIMER2" : "match 4",
+           (unsigned long long)step_calls, (unsigned long long)steps,
+           steps ? (double)step_calls / steps : 0.0);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    float battery = 0.8f;
+    float sag = 0.0f;
+    int dip = 0;
+    uint64_t start_ms = 0;  // 0 to wait for kReadyByte
+    uint64_t timeout_ms = 60000;
+    uint64_t noise_ms = 0;
+    size_t depth = 1;
+    const char* flash_file = NULL;
+    std::vector<const char*> commands;
+    std::vector<Move> moves;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-b") == 0) {
+            framed = true;
+            continue;
+        }
+        if (strcmp(argv[i], "-r") == 0) {
+            results_only = true;
+            continue;
+        }
+        if (argv[i][0] == '-') {
+            if (i + 1 >= argc || argv[i][2] != '\0') {
+                Usage();
+            }
+            const char* value = argv[++i];
+            switch (argv[i - 1][1]) {
+                case 'v': battery = (float)atof(value); break;
+                case 'g': sag = (float)atof(value); break;
+                case 'd': dip = atoi(value); break;
+                case 's': start_ms = strtoull(value, NULL, 10); break;
+                case 't': timeout_ms = strtoull(value, NULL, 10); break;
+                case 'q': depth = (size_t)atoi(value); break;
+                case 'k': turn_factor = atof(value); break;
+                case 'j': knock_at = sim::FromMicroseconds(strtoull(value, NULL, 10) * 1000); break;
+                case 'T':
+                    telemetry = fopen(value, "wb");
+                    if (!telemetry) {
+                        perror(value);
+                        exit(1);
+                    }
+                    break;
+                case 'n': noise_ms = strtoull(value, NULL, 10); break;
+                case 'z': gyro_offset = atof(value); break;
+                case 'F': flash_file = value; break;
+                default: Usage();
+            }
+            continue;
+        }
+        commands.push_back(argv[i]);
+    }
+    // After the options, since -b changes what an argument can be.
+    for (size_t i = 0; i < commands.size(); i++) {
+        Move move;
+        if (!ParseMove(commands[i], &move)) {
+            fprintf(stderr, "bench: bad command '%s'\n", commands[i]);
+            Usage();
+        }
+        moves.push_back(move);
+    }
+    if (moves.empty()) {
+        for (size_t i = 0; i < sizeof(kDefaultRoute) / sizeof(kDefaultRoute[0]); i++) {
+            Move move;
+            ParseMove(kDefaultRoute[i], &move);
+            moves.push_back(move);
+        }
+    }
+
+    sim::SetAnalogIn(p15, battery);
+    sim::SetBatterySag(sag);
+    sim::SetBusIn(dip);
+    sim::SetTxHook(OnTx);
+    sim::SetGyroSource(RobotGyro);
+    Pi the_pi(&moves, start_ms ? sim::FromMicroseconds(start_ms * 1000) : sim::kNever,
+              sim::FromMicroseconds(timeout_ms * 1000), depth ? depth : 1);
+    pi = &the_pi;
+    Noise noise(noise_ms ? sim::FromMicroseconds(noise_ms * 1000) : sim::kNever);
+    if (flash_file) {
+        FILE* flash = fopen(flash_file, "rb");
+        if (flash) {
+            fread(sim::FlashSector(), 1, sim::kFlashSectorSize, flash);
+            fclose(flash);
+        }
+    }
+
+    try {
+        firmware_main();
+    } catch (const sim::Finished&) {
+    }
+    Report(moves);
+    if (telemetry) {
+        fclose(telemetry);
+    }
+    if (flash_file) {
+        FILE* flash = fopen(flash_file, "wb");
+        if (!flash || fwrite(sim::FlashSector(), 1, sim::kFlashSectorSize, flash)
+                      != sim::kFlashSectorSize) {
+            perror(flash_file);
+            return 1;
+        }
+        fclose(flash);
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,227 @@
+/* checks.cpp
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// Checks the parts of the firmware that can be tried on their own, without
+// running a route through bench: the framed protocol's CRC and FrameReader,
+// the fixed point in robot_profile.h, GyroBias, the calibration record in
+// flash, and the pose's heading. Prints what failed, and exits with 1 if anything did, so that
+// "make check" stops.
+//
+// Usage: checks
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mbed.h"
+#include "sim.h"
+
+#include "frames.h"
+#include "robot_profile.h"
+#include "robot_specific.h"
+#include "gyro.h"
+#include "gyro_bias.h"
+#include "calibration.h"
+#include "iap_constants.h"
+#include "interrupt_handlers.h"
+#include "pose.h"
+
+namespace {
+
+int checked = 0;
+int failed = 0;
+
+void Check(bool ok, const char* what) {
+    checked++;
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        failed++;
+    }
+}
+
+void CheckCrc8() {
+    // The standard check value for CRC-8/SMBus.
+    const char* digits = "123456789";
+    uint8_t crc = 0;
+    for (int i = 0; digits[i]; i++) {
+        crc = Crc8(crc, (uint8_t)digits[i]);
+    }
+    Check(crc == 0xF4, "Crc8 of \"123456789\" is 0xF4");
+}
+
+// Feeds |length| bytes of |frame| (from the length on) to |reader|, and
+// returns what the last one gave, or kBadFrame if one before it wasn't
+// kIncomplete.
+FrameReader::Result Feed(FrameReader* reader, const uint8_t* frame, int length) {
+    for (int i = 0; i < length - 1; i++) {
+        if (reader->Add(frame[i]) != FrameReader::kIncomplete) {
+            return FrameReader::kBadFrame;
+        }
+    }
+    return reader->Add(frame[length - 1]);
+}
+
+void CheckFrameReader() {
+    // kOpLeft 100.00 degrees, sequence number 7.
+    uint8_t frame[] = {4, kOpLeft, 7, 0x10, 0x27, 0};
+    for (int i = 0; i < 5; i++) {
+        frame[5] = Crc8(frame[5], frame[i]);
+    }
+    FrameReader reader;
+    Check(Feed(&reader, frame, 6) == FrameReader::kComplete, "a good frame is complete");
+    Check(reader.length() == 4 && memcmp(reader.body(), frame + 1, 4) == 0,
+          "a good frame's body comes through");
+
+    frame[5] ^= 1;
+    Check(Feed(&reader, frame, 6) == FrameReader::kBadFrame, "a bad CRC is a bad frame");
+    frame[5] ^= 1;
+    Check(Feed(&reader, frame, 6) == FrameReader::kComplete,
+          "the frame after a bad one is read");
+
+    Check(reader.Add(0) == FrameReader::kNotAFrame, "a length of 0 is not a frame");
+    Check(reader.Add(kMaxFrameBody + 1) == FrameReader::kNotAFrame,
+          "a length over kMaxFrameBody is not a frame");
+    Check(reader.Add('f') == FrameReader::kNotAFrame,
+          "a one-character command after kFrameSync is not a frame");
+    Check(reader.Add(kMaxFrameBody) == FrameReader::kIncomplete,
+          "a length of kMaxFrameBody starts a frame");
+    reader.Reset();
+}
+
+void CheckScaleQ16() {
+    Check(ScaleQ16(100, 65536) == 100, "ScaleQ16 by one");
+    Check(ScaleQ16(-100, 65536) == -100, "ScaleQ16 of a negative count");
+    Check(ScaleQ16(1, 32768) == 1 && ScaleQ16(1, 32767) == 0, "ScaleQ16 rounds halves up");
+    bool close = true;
+    // Up to 'F' 255, which needs the 64-bit product.
+    for (int count = 0; count <= 2550; count++) {
+        double exact = count * (double)kDefaultStepsPerCentimetre / 65536;
+        close = close && fabs(ScaleQ16(count, kDefaultStepsPerCentimetre) - exact) <= 0.5;
+        exact = count * (double)kDefaultStepsPerCentimetre / 65536 / 10;
+        close = close && fabs(ScaleQ16((int64_t)count, kDefaultStepsPerCentimetre, 10)
+                              - exact) <= 0.5;
+    }
+    Check(close, "ScaleQ16 is within half a step of the exact answer");
+    Check(ScaleQ16(2550, kDefaultStepsPerCentimetre) > 0, "'F' 255 doesn't overflow");
+}
+
+void CheckGyroBias() {
+    GyroBias bias;
+    bias.Update(300, true);
+    Check(bias.bias() == 300 << 8, "GyroBias learns from the first sample");
+    for (int i = 1; i < kGyroBiasStartSamples; i++) {
+        bias.Update(300, true);
+    }
+    Check(bias.settled(), "GyroBias settles after kGyroBiasStartSamples");
+    Check(bias.Update(300, true) == 0, "GyroBias takes the offset out");
+
+    Check(bias.Update(1300, false) == 1000, "GyroBias takes it out whilst moving");
+    Check(bias.bias() == 300 << 8, "GyroBias doesn't learn whilst moving");
+    for (int i = 0; i < kGyroBiasSettleSamples; i++) {
+        bias.Update(400, true);
+    }
+    Check(bias.bias() == 300 << 8, "GyroBias doesn't learn whilst settling");
+    bias.Update(300 + kGyroBiasGate + 1, true);
+    Check(bias.bias() == 300 << 8, "GyroBias ignores samples outside the gate");
+    bias.Update(310, true);
+    Check(bias.bias() > 300 << 8, "GyroBias follows drift after settling");
+
+    GyroBias half;
+    for (int i = 0; i < kGyroBiasStartSamples; i++) {
+        half.Update((int16_t)(300 + (i & 1)), true);
+    }
+    Check(half.bias() == (300 << 8) + 128, "GyroBias keeps fractions of a unit");
+    int32_t total = 0;
+    for (int i = 0; i < 1000; i++) {
+        total += half.Update((int16_t)(300 + (i & 1)), false);
+    }
+    Check(total >= -1 && total <= 1, "GyroBias carries its rounding error forward");
+    Check(half.Update(-32768, false) == -32768, "GyroBias clamps what it returns");
+}
+
+void CheckCalibrationRecord() {
+    uint8_t* flash = sim::FlashSector();
+    LoadCalibration();
+    Check(steps_per_centimetre == kDefaultStepsPerCentimetre,
+          "the defaults are used with nothing in flash");
+
+    Check(CalibrateDistance(500, 490), "a distance calibration is saved");
+    uint32_t first = (uint32_t)((uint64_t)kDefaultStepsPerCentimetre * 500 / 490);
+    Check(steps_per_centimetre == first, "a distance calibration scales steps_per_centimetre");
+    Check(memcmp(flash, "CALB", 4) == 0, "the record starts with its magic number");
+
+    Check(CalibrateDistance(510, 500), "a second calibration is saved");
+    uint32_t second = steps_per_centimetre;
+    Check(flash[IAP_MIN_COPY] != 0xFF && second != first, "it goes in the next slot");
+    // As if the robot had been reset whilst writing it.
+    flash[IAP_MIN_COPY + 8] ^= 1;
+    LoadCalibration();
+    Check(steps_per_centimetre == first, "a damaged record leaves the one before it");
+    flash[IAP_MIN_COPY + 8] ^= 1;
+    LoadCalibration();
+    Check(steps_per_centimetre == second, "the last good record is loaded");
+
+    // Fill the rest of the sector, and save once more.
+    bool saved = true;
+    for (int i = 2; i < IAP_LAST_SECTOR_SIZE / IAP_MIN_COPY + 1; i++) {
+        saved = saved && CalibrateDistance(500, 500);
+    }
+    Check(saved, "the sector is erased when it fills up");
+    Check(flash[IAP_MIN_COPY] == 0xFF, "saving starts again at the first slot");
+    LoadCalibration();
+    Check(steps_per_centimetre == second, "the record after erasing is loaded");
+
+    Check(ForgetCalibration(), "the calibration can be forgotten");
+    Check(steps_per_centimetre == kDefaultStepsPerCentimetre && flash[0] == 0xFF,
+          "forgetting goes back to the defaults and erases the sector");
+    LoadCalibration();
+    Check(steps_per_centimetre == kDefaultStepsPerCentimetre,
+          "nothing is loaded after forgetting");
+}
+
+void CheckPoseHeading() {
+    yaw = 0;
+    InitPose(true);
+    // 50 turns and 45 degrees to the left, ten degrees at a time, which takes
+    // yaw past 2^31 and round again.
+    uint32_t turned = 0;
+    for (int i = 0; i < 50 * 36 + 4; i++) {
+        turned += 10 * kGyroUnitsPerDegree;
+        yaw = (int32_t)turned;
+        UpdatePose();
+    }
+    turned += 5 * kGyroUnitsPerDegree;
+    yaw = (int32_t)turned;
+    UpdatePose();
+    Check(CurrentPose().heading == 4500, "the heading survives yaw wrapping");
+    for (int i = 0; i < 50 * 36 + 18; i++) {
+        turned -= 10 * kGyroUnitsPerDegree;
+        yaw = (int32_t)turned;
+        UpdatePose();
+    }
+    Check(CurrentPose().heading == -13500, "and wrapping back the other way");
+    SetPose(0, 0, 17999);
+    turned += kGyroUnitsPerDegree / 100;
+    yaw = (int32_t)turned;
+    UpdatePose();
+    Check(CurrentPose().heading == -18000, "the heading goes round from 17999 to -18000");
+}
+
+}  // namespace
+
+int main() {
+    CheckCrc8();
+    CheckFrameReader();
+    CheckScaleQ16();
+    CheckGyroBias();
+    CheckCalibrationRecord();
+    CheckPoseHeading();
+    printf("checks: %d of %d passed\n", checked - failed, checked);
+    return failed ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,366 @@
+/* mbed.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// Stand-in for the parts of the mbed library and the LPC17xx CMSIS headers
+// that the firmware uses, for the host build only (see sim.h). The classes
+// have the same interfaces as the real ones, but every call charges the
+// virtual clock roughly what it costs on the LPC1768 instead of touching
+// hardware. Only add what the firmware actually uses.
+
+#ifndef JDH_16_17_RASPI3_HOST_MBED_H_
+#define JDH_16_17_RASPI3_HOST_MBED_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#include "sim.h"
+
+/********************************* Pin names **********************************/
+
+enum PinName {
+    p5 = 5, p6, p7, p8, p9, p10, p11, p12, p13, p14, p15, p16, p17, p18, p19,
+    p20, p21, p22, p23, p24, p25, p26, p27, p28, p29, p30,
+    LED1 = 40, LED2, LED3, LED4,
+    USBTX = 50, USBRX,
+    NC = -1
+};
+
+/*********************************** CMSIS ************************************/
+
+enum IRQn_Type {
+    WDT_IRQn = 0,
+    TIMER0_IRQn = 1,
+    TIMER1_IRQn = 2,
+    TIMER2_IRQn = 3,
+    TIMER3_IRQn = 4,
+    UART0_IRQn = 5,
+    UART1_IRQn = 6,
+    UART2_IRQn = 7,
+    UART3_IRQn = 8,
+    PWM1_IRQn = 9,
+    I2C0_IRQn = 10,
+    I2C1_IRQn = 11,
+    I2C2_IRQn = 12,
+    EINT3_IRQn = 21,
+    ADC_IRQn = 22,
+    DMA_IRQn = 26
+};
+
+// The firmware casts handler addresses to uint32_t, which is only lossless
+// because the host build is linked below 4 GiB (see the Makefile).
+inline void NVIC_SetVector(IRQn_Type irq, uint32_t vector) {
+    sim::SetVector(irq, (void (*)())(uintptr_t)vector);
+}
+inline void NVIC_EnableIRQ(IRQn_Type irq) {sim::EnableIrq(irq, true);}
+inline void NVIC_DisableIRQ(IRQn_Type irq) {sim::EnableIrq(irq, false);}
+inline void NVIC_SetPendingIRQ(IRQn_Type irq) {sim::SetPending(irq);}
+inline void __disable_irq() {sim::MaskInterrupts(true);}
+inline void __enable_irq() {sim::MaskInterrupts(false);}
+inline uint32_t __get_PRIMASK() {return sim::InterruptsMasked() ? 1 : 0;}
+inline void __set_PRIMASK(uint32_t primask) {sim::MaskInterrupts((primask & 1) != 0);}
+inline void __WFI() {sim::WaitForEvent();}
+// One thread, so only the compiler has to be kept from reordering.
+inline void __DMB() {__asm__ __volatile__("" ::: "memory");}
+inline uint32_t __CLZ(uint32_t value) {return value ? __builtin_clz(value) : 32;}
+
+// The cycle counter counts the virtual clock.
+class CycleCounter {
+  public:
+    CycleCounter() : zero_(0) {}
+    CycleCounter& operator=(uint32_t value) {zero_ = sim::Now() - value; return *this;}
+    operator uint32_t() const {return (uint32_t)(sim::Now() - zero_);}
+  private:
+    uint64_t zero_;
+};
+struct DWT_Type {
+    uint32_t CTRL;
+    CycleCounter CYCCNT;
+};
+struct CoreDebug_Type {
+    uint32_t DEMCR;
+};
+#define DWT_CTRL_CYCCNTENA_Msk (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+extern DWT_Type* const DWT;
+extern CoreDebug_Type* const CoreDebug;
+
+// Writing a 1 to a bit of an interrupt register clears it; writing 0 does
+// nothing.
+class WriteOneToClear {
+  public:
+    WriteOneToClear() : value_(0) {}
+    WriteOneToClear& operator=(uint32_t bits) {value_ &= ~bits; return *this;}
+    operator uint32_t() const {return value_;}
+    // For the peripheral models only.
+    void Set(uint32_t bits) {value_ |= bits;}
+  private:
+    uint32_t value_;
+};
+
+struct LPC_PWM_TypeDef {
+    WriteOneToClear IR;
+    uint32_t TCR;
+    uint32_t TC;
+    uint32_t PR;
+    uint32_t PC;
+    uint32_t MCR;
+    uint32_t MR0;
+    uint32_t MR1;
+    uint32_t MR2;
+    uint32_t MR3;
+    uint32_t CCR;
+    uint32_t CR0;
+    uint32_t CR1;
+    uint32_t CR2;
+    uint32_t CR3;
+    uint32_t MR4;
+    uint32_t MR5;
+    uint32_t MR6;
+    uint32_t PCR;
+    uint32_t LER;
+    uint32_t CTCR;
+};
+extern LPC_PWM_TypeDef* const LPC_PWM1;
+
+// Only TIMER2 is there, and only its counter mode is modelled, counting the
+// step pulses on p23 as if p23 were wired to p30 (CAP2.0). Matches on MR0 and
+// MR1 make DMA requests.
+struct LPC_TIM_TypeDef {
+    WriteOneToClear IR;
+    uint32_t TCR;
+    uint32_t TC;
+    uint32_t PR;
+    uint32_t PC;
+    uint32_t MCR;
+    uint32_t MR0;
+    uint32_t MR1;
+    uint32_t MR2;
+    uint32_t MR3;
+    uint32_t CCR;
+    uint32_t CR0;
+    uint32_t CR1;
+    uint32_t EMR;
+    uint32_t CTCR;
+};
+extern LPC_TIM_TypeDef* const LPC_TIM2;
+
+// Just the registers the firmware touches.
+struct LPC_SC_TypeDef {
+    uint32_t PCONP;
+    uint32_t PCLKSEL0;
+    uint32_t PCLKSEL1;
+    uint32_t DMAREQSEL;
+};
+extern LPC_SC_TypeDef* const LPC_SC;
+
+struct LPC_PINCON_TypeDef {
+    uint32_t PINSEL0;
+    uint32_t PINSEL1;
+    uint32_t PINSEL2;
+    uint32_t PINSEL3;
+    uint32_t PINSEL4;
+};
+extern LPC_PINCON_TypeDef* const LPC_PINCON;
+
+// Writing a 1 to a bit of this register clears that bit in another one.
+class ClearsBitsIn {
+  public:
+    explicit ClearsBitsIn(WriteOneToClear* target) : target_(target) {}
+    ClearsBitsIn& operator=(uint32_t bits) {*target_ = bits; return *this;}
+  private:
+    WriteOneToClear* target_;
+};
+
+// Only memory-to-peripheral transfers of single bytes or words are modelled,
+// with the timer match and UART3 Tx DMA requests.
+struct LPC_GPDMA_TypeDef {
+    LPC_GPDMA_TypeDef() : DMACIntTCClear(&DMACIntTCStat), DMACIntErrClr(&DMACIntErrStat) {}
+    uint32_t DMACIntStat;
+    WriteOneToClear DMACIntTCStat;
+    ClearsBitsIn DMACIntTCClear;
+    WriteOneToClear DMACIntErrStat;
+    ClearsBitsIn DMACIntErrClr;
+    uint32_t DMACRawIntTCStat;
+    uint32_t DMACRawIntErrStat;
+    uint32_t DMACEnbldChns;
+    uint32_t DMACSoftBReq;
+    uint32_t DMACSoftSReq;
+    uint32_t DMACSoftLBReq;
+    uint32_t DMACSoftLSReq;
+    uint32_t DMACConfig;
+    uint32_t DMACSync;
+};
+extern LPC_GPDMA_TypeDef* const LPC_GPDMA;
+
+// Addresses are 32 bits, as on the LPC1768; see the Makefile.
+struct LPC_GPDMACH_TypeDef {
+    uint32_t DMACCSrcAddr;
+    uint32_t DMACCDestAddr;
+    uint32_t DMACCLLI;
+    uint32_t DMACCControl;
+    uint32_t DMACCConfig;
+};
+extern LPC_GPDMACH_TypeDef* const LPC_GPDMACH0;
+extern LPC_GPDMACH_TypeDef* const LPC_GPDMACH1;
+extern LPC_GPDMACH_TypeDef* const LPC_GPDMACH2;
+extern LPC_GPDMACH_TypeDef* const LPC_GPDMACH3;
+extern LPC_GPDMACH_TypeDef* const LPC_GPDMACH4;
+extern LPC_GPDMACH_TypeDef* const LPC_GPDMACH5;
+extern LPC_GPDMACH_TypeDef* const LPC_GPDMACH6;
+extern LPC_GPDMACH_TypeDef* const LPC_GPDMACH7;
+
+// Only what the firmware needs to feed UART3 from the DMA: the DMA's writes to
+// THR are sent, but the firmware's own aren't (it uses Serial for that).
+struct LPC_UART_TypeDef {
+    uint32_t THR;
+    uint32_t FCR;
+};
+extern LPC_UART_TypeDef* const LPC_UART3;
+
+// Reading an ADC result register clears its DONE bit, and with it the
+// interrupt.
+class AdcResult {
+  public:
+    AdcResult() : value_(0) {}
+    operator uint32_t() {uint32_t value = value_; value_ &= ~0xC0000000u; return value;}
+    // For the peripheral models only.
+    void Set(uint32_t value) {value_ = value;}
+    uint32_t Peek() const {return value_;}
+  private:
+    uint32_t value_;
+};
+
+// Only burst mode on channel 0 (p15) is modelled.
+struct LPC_ADC_TypeDef {
+    uint32_t ADCR;
+    uint32_t ADINTEN;
+    AdcResult ADDR0;
+};
+extern LPC_ADC_TypeDef* const LPC_ADC;
+
+extern uint32_t SystemCoreClock;
+
+// See iap_constants.h.
+#define IAP_LOCATION (&sim::Iap)
+#define IAP_LAST_SECTOR_ADDRESS (sim::FlashSector())
+
+/********************************** mbed API **********************************/
+
+void wait(float s);
+void wait_ms(int ms);
+void wait_us(int us);
+uint32_t us_ticker_read();
+
+class DigitalOut {
+  public:
+    DigitalOut(PinName pin) : pin_(pin), value_(0) {}
+    void write(int value);
+    int read() {return value_;}
+    DigitalOut& operator=(int value) {write(value); return *this;}
+    DigitalOut& operator=(DigitalOut& rhs) {write(rhs.read()); return *this;}
+    operator int() {return read();}
+  private:
+    PinName pin_;
+    int value_;
+};
+
+class BusIn {
+  public:
+    BusIn(PinName p0, PinName p1 = NC, PinName p2 = NC, PinName p3 = NC,
+          PinName p4 = NC, PinName p5 = NC, PinName p6 = NC, PinName p7 = NC);
+    int read();
+    operator int() {return read();}
+};
+
+class AnalogIn {
+  public:
+    AnalogIn(PinName pin) : pin_(pin) {}
+    float read();
+    unsigned short read_u16();
+    operator float() {return read();}
+  private:
+    PinName pin_;
+};
+
+// Only p23 (PWM1 channel 4) is modelled, since that's the step clock.
+class PwmOut {
+  public:
+    PwmOut(PinName pin);
+    void write(float value);
+    float read();
+    void period(float seconds);
+    void period_ms(int ms);
+    void period_us(int us);
+    void pulsewidth(float seconds);
+    void pulsewidth_ms(int ms);
+    void pulsewidth_us(int us);
+    PwmOut& operator=(float value) {write(value); return *this;}
+    operator float() {return read();}
+  private:
+    volatile uint32_t* match_;
+    int channel_;
+};
+
+class Serial {
+  public:
+    enum IrqType {RxIrq = 0, TxIrq};
+    Serial(PinName tx, PinName rx);
+    void baud(int baudrate);
+    int getc();
+    int putc(int c);
+    int readable();
+    int writeable();
+    void attach(void (*fptr)(), IrqType type = RxIrq);
+  private:
+    int uart_;
+};
+
+// Only the MPU6050 is on the bus (see MPU6050.h). Transactions block for as
+// long as they would take at the set frequency.
+class I2C {
+  public:
+    I2C(PinName sda, PinName scl) : hz_(100000) {}
+    void frequency(int hz) {hz_ = hz;}
+    // Both return 0 if the device acknowledged.
+    int read(int address, char* data, int length, bool repeated = false);
+    int write(int address, const char* data, int length, bool repeated = false);
+  private:
+    int hz_;
+};
+
+// Only p29 has anything driving it: the MPU6050's INT pin.
+class InterruptIn {
+  public:
+    InterruptIn(PinName pin);
+    ~InterruptIn();
+    void rise(void (*fptr)());
+    // For the stand-in HAL only.
+    PinName pin_;
+    void (*rise_handler_)();
+    bool due_;
+    InterruptIn* link_;
+};
+
+class Ticker {
+  public:
+    Ticker();
+    ~Ticker();
+    void attach(void (*fptr)(), float t);
+    void attach_us(void (*fptr)(), unsigned int t);
+    void detach();
+    // For the stand-in HAL only.
+    uint64_t next_;
+    uint64_t interval_;
+    void (*handler_)();
+    bool due_;
+    Ticker* link_;
+};
+
+#endif  // JDH_16_17_RASPI3_HOST_MBED_H_
\ No newline at end of file
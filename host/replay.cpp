@@ -0,0 +1,312 @@
+/* replay.cpp
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// Feeds gyro traces through each of the collision detectors in
+// collision_detector.h (and the old 512-sample average, for comparison), as
+// main() would, and prints how quickly each one noticed the collisions and how
+// often it cried wolf.
+//
+// Usage: replay [-e shift:threshold] [-c slack:limit] [-j threshold]
+//               [-n count] [-r seed] [-u] [trace...]
+//     -e  EmaDetector settings (default kEmaShift:kEmaThreshold)
+//     -c  CusumDetector settings (default kCusumSlack:kCusumLimit)
+//     -j  JerkDetector threshold (default kJerkThreshold)
+//     -n  how many made-up traces to use when no files are given (default 200)
+//     -r  seed for the made-up traces (default 1)
+//     -u  give the detectors the raw samples, as main() used to, rather than
+//         taking the gyro's offset out first (see gyro_bias.h)
+//
+// A trace is one move: a text file with one raw Z rate per line, at
+// kGyroSampleRateHz. If there's a line saying "moving", the samples before it
+// were taken with the robot standing still beforehand, and only go to
+// GyroBias; otherwise the trace starts as the move does. A line saying
+// "collision" goes just before the first sample taken after the robot hit
+// something; without one, the move was clear all the way. Lines starting with
+// # are ignored.
+//
+// Without any files, it makes up traces instead: a wait of 0.5 to 1.5 s
+// beforehand, then sensor noise, motor vibration, a wobble as the move
+// starts, and (in half of them) a collision that turns the robot at up to
+// about 11 degrees/s, all on top of an offset of up to 1.5 degrees/s that
+// drifts a little as it goes. They are only a stand-in for traces recorded
+// on the robot.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "collision_detector.h"
+#include "gyro.h"
+#include "gyro_bias.h"
+
+namespace {
+
+const double kPi = 3.14159265358979;
+
+struct Trace {
+    std::string name;
+    std::vector<int16_t> idle;  // before the move
+    std::vector<int16_t> samples;
+    int onset;  // index of the first sample after the collision, or -1
+};
+
+// The old detector in main(): the mean of the last 512 samples outside +-4,
+// ignoring the first 512 of each move.
+class WindowDetector : public CollisionDetector {
+  public:
+    WindowDetector() {Reset();}
+    void Reset() {
+        memset(window_, 0, sizeof(window_));
+        oldest_ = 0;
+        sum_ = 0;
+    }
+    bool Update(int16_t rate) {
+        sum_ += rate - window_[oldest_];
+        window_[oldest_] = rate;
+        oldest_ = (oldest_ + 1) % kWindow;
+        int mean = sum_ / kWindow;
+        return mean > 4 || mean < -4;
+    }
+    int32_t Level() const {
+        int mean = sum_ / kWindow;
+        return mean < 0 ? -mean : mean;
+    }
+    static const int kWindow = 512;
+  private:
+    int16_t window_[kWindow];
+    int oldest_;
+    int32_t sum_;
+};
+
+struct Entry {
+    const char* name;
+    CollisionDetector* detector;
+    int settle;  // samples ignored at the start of the move
+    // Results.
+    int collisions;
+    int detected;
+    int64_t total_latency;
+    int max_latency;
+    int false_alarms;
+    int64_t clear_samples;
+};
+
+void Usage() {
+    fprintf(stderr, "usage: replay [-e shift:threshold] [-c slack:limit] [-j threshold]\n"
+                    "              [-n count] [-r seed] [-u] [trace...]\n");
+    exit(2);
+}
+
+bool LoadTrace(const char* path, Trace* trace) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    trace->name = path;
+    trace->idle.clear();
+    trace->samples.clear();
+    trace->onset = -1;
+    char line[128];
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') {
+            continue;
+        }
+        if (strncmp(line, "collision", 9) == 0) {
+            trace->onset = (int)trace->samples.size();
+            continue;
+        }
+        if (strncmp(line, "moving", 6) == 0) {
+            trace->idle.swap(trace->samples);
+            trace->samples.clear();
+            continue;
+        }
+        trace->samples.push_back((int16_t)atoi(line));
+    }
+    fclose(file);
+    return true;
+}
+
+// Deterministic, so that runs can be compared.
+uint32_t random_state = 1;
+
+double Uniform() {
+    random_state = random_state * 1103515245u + 12345u;
+    return ((random_state >> 8) + 0.5) / 16777216.0;
+}
+
+double Gaussian() {
+    return sqrt(-2.0 * log(Uniform())) * cos(2.0 * kPi * Uniform());
+}
+
+void MakeTrace(int index, Trace* trace) {
+    const double kRate = kGyroSampleRateHz;
+    char name[32];
+    snprintf(name, sizeof(name), "made-up %d", index);
+    trace->name = name;
+    int length = (int)(2000 + 2000 * Uniform());
+    int idle = (int)(500 + 1000 * Uniform());
+    double bias = 400.0 * Uniform() - 200.0;
+    double drift = (10.0 * Uniform() - 5.0) / (idle + length);  // per sample
+    double vibration_hz = 20.0 + 40.0 * Uniform();
+    double wobble_hz = 15.0 + 15.0 * Uniform();
+    bool collides = index % 2 == 1;
+    trace->onset = collides ? (int)(300 + (length - 800) * Uniform()) : -1;
+    // Log-uniform between about 0.5 and 11 degrees/s.
+    double turn = 60.0 * exp(log(25.0) * Uniform()) * (Uniform() < 0.5 ? -1 : 1);
+    trace->idle.resize(idle);
+    for (int i = 0; i < idle; i++) {
+        trace->idle[i] = (int16_t)floor(bias + drift * i + 8.0 * Gaussian() + 0.5);
+    }
+    trace->samples.resize(length);
+    for (int i = 0; i < length; i++) {
+        double t = i / kRate;
+        double rate = bias + drift * (idle + i) + 8.0 * Gaussian()
+                      + 12.0 * sin(2.0 * kPi * vibration_hz * t)
+                      + 80.0 * exp(-t / 0.01) * sin(2.0 * kPi * wobble_hz * t);
+        if (collides && i >= trace->onset) {
+            double since = (i - trace->onset) / kRate;
+            rate += turn * (1.0 - exp(-since / 0.015));
+        }
+        trace->samples[i] = (int16_t)floor(rate + 0.5);
+    }
+}
+
+bool raw = false;  // -u
+
+void Replay(const Trace& trace, Entry* entry) {
+    CollisionDetector* detector = entry->detector;
+    detector->Reset();
+    // As main() would have had it, sitting there since it was switched on.
+    GyroBias bias;
+    for (size_t i = 0; i < trace.idle.size(); i++) {
+        bias.Update(trace.idle[i], true);
+    }
+    int clear_until = trace.onset >= 0 ? trace.onset : (int)trace.samples.size();
+    if (trace.onset >= 0) {
+        entry->collisions++;
+    }
+    for (int i = 0; i < (int)trace.samples.size(); i++) {
+        int16_t rate = bias.Update(trace.samples[i], false);
+        if (raw) {
+            rate = trace.samples[i];
+        }
+        if (i < entry->settle) {
+            detector->Reset();
+            continue;
+        }
+        if (i < clear_until) {
+            entry->clear_samples++;
+        }
+        if (!detector->Update(rate)) {
+            continue;
+        }
+        if (i < clear_until) {
+            // The robot would have stopped here for nothing. Carry on as if
+            // it had been told to start again, to see how often it happens.
+            entry->false_alarms++;
+            detector->Reset();
+            continue;
+        }
+        int latency = i - std::max(trace.onset, entry->settle);
+        entry->detected++;
+        entry->total_latency += latency;
+        entry->max_latency = std::max(entry->max_latency, latency);
+        return;
+    }
+}
+
+bool ParsePair(const char* value, int* first, int* second) {
+    return sscanf(value, "%d:%d", first, second) == 2;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    int ema_shift = kEmaShift;
+    int ema_threshold = kEmaThreshold;
+    int cusum_slack = kCusumSlack;
+    int cusum_limit = kCusumLimit;
+    int jerk_threshold = kJerkThreshold;
+    int count = 200;
+    std::vector<Trace> traces;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-u") == 0) {
+            raw = true;
+            continue;
+        }
+        if (argv[i][0] == '-') {
+            if (i + 1 >= argc || argv[i][2] != '\0') {
+                Usage();
+            }
+            const char* value = argv[++i];
+            bool ok = true;
+            switch (argv[i - 1][1]) {
+                case 'e': ok = ParsePair(value, &ema_shift, &ema_threshold); break;
+                case 'c': ok = ParsePair(value, &cusum_slack, &cusum_limit); break;
+                case 'j': jerk_threshold = atoi(value); break;
+                case 'n': count = atoi(value); break;
+                case 'r': random_state = (uint32_t)strtoul(value, NULL, 10); break;
+                default: Usage();
+            }
+            if (!ok) {
+                Usage();
+            }
+            continue;
+        }
+        Trace trace;
+        if (!LoadTrace(argv[i], &trace)) {
+            fprintf(stderr, "replay: can't read '%s'\n", argv[i]);
+            return 1;
+        }
+        traces.push_back(trace);
+    }
+    if (traces.empty()) {
+        traces.resize(count);
+        for (int i = 0; i < count; i++) {
+            MakeTrace(i, &traces[i]);
+        }
+    }
+
+    WindowDetector window;
+    EmaDetector ema(ema_shift, ema_threshold);
+    CusumDetector cusum(cusum_slack, cusum_limit);
+    JerkDetector jerk(jerk_threshold);
+    Entry entries[] = {
+        {"old 512 average", &window, WindowDetector::kWindow},
+        {"EmaDetector", &ema, kCollisionSettleSamples},
+        {"CusumDetector", &cusum, kCollisionSettleSamples},
+        {"JerkDetector", &jerk, kCollisionSettleSamples},
+    };
+    const int kEntries = sizeof(entries) / sizeof(entries[0]);
+
+    for (size_t t = 0; t < traces.size(); t++) {
+        for (int e = 0; e < kEntries; e++) {
+            Replay(traces[t], &entries[e]);
+        }
+    }
+
+    printf("%-16s %9s %8s %12s %12s %13s\n", "detector", "detected", "missed",
+           "mean lag/ms", "max lag/ms", "false/minute");
+    for (int e = 0; e < kEntries; e++) {
+        const Entry& entry = entries[e];
+        double ms_per_sample = 1000.0 / kGyroSampleRateHz;
+        double clear_minutes = entry.clear_samples / (60.0 * kGyroSampleRateHz);
+        printf("%-16s %5d/%-3d %8d %12.1f %12.1f %13.2f\n", entry.name,
+               entry.detected, entry.collisions, entry.collisions - entry.detected,
+               entry.detected ? ms_per_sample * entry.total_latency / entry.detected : 0.0,
+               ms_per_sample * entry.max_latency,
+               clear_minutes > 0 ? entry.false_alarms / clear_minutes : 0.0);
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,1338 @@
+/* sim.cpp
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+#include "sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "mbed.h"
+#include "MPU6050.h"
+
+namespace sim {
+
+namespace {
+
+// Rough costs of things on the LPC1768, in core clock cycles. These don't need
+// to be exact, just in proportion; they are what the ISR occupancy figures are
+// made of, so if you measure one on the real robot, put it in here.
+const uint64_t kExceptionCycles = 24;         // stacking + unstacking
+const uint64_t kMbedIrqWrapperCycles = 60;    // mbed's Serial/Ticker dispatch
+const uint64_t kDigitalOutCycles = 8;
+const uint64_t kBusInCycles = 20;
+const uint64_t kAnalogInReadCycles = 2600;    // several conversions + median
+const uint64_t kPwmPeriodCycles = 250;        // includes a software divide
+const uint64_t kPwmWriteCycles = 300;         // soft-float multiply
+const uint64_t kSerialCallCycles = 40;
+
+const int kUartFifoSize = 16;
+const int kIrqCount = 32;
+
+struct NvicEntry {
+    void (*vector)();
+    bool internal;
+    bool enabled;
+    bool pending;  // set by NVIC_SetPendingIRQ(), cleared on entry
+    IrqLine line;
+};
+
+uint64_t now = 0;
+bool in_isr = false;
+bool masked = false;
+uint64_t isr_cycles = 0;
+NvicEntry nvic[kIrqCount];
+std::map<void (*)(), HandlerStats> stats;
+
+std::vector<EventSource*>& Sources() {
+    static std::vector<EventSource*> sources;
+    return sources;
+}
+
+uint64_t Earliest(EventSource** source) {
+    uint64_t earliest = kNever;
+    *source = NULL;
+    std::vector<EventSource*>& sources = Sources();
+    for (size_t i = 0; i < sources.size(); i++) {
+        uint64_t when = sources[i]->NextEvent();
+        if (when < earliest) {
+            earliest = when;
+            *source = sources[i];
+        }
+    }
+    return earliest;
+}
+
+int HighestPending() {
+    for (int irq = 0; irq < kIrqCount; irq++) {
+        NvicEntry& entry = nvic[irq];
+        if (entry.enabled && entry.vector
+                && (entry.pending || (entry.line && entry.line()))) {
+            return irq;
+        }
+    }
+    return -1;
+}
+
+/*********************************** GPDMA ************************************/
+
+// Channels run memory-to-peripheral transfers of a byte or a word (the source
+// width; the destination is taken to be the same), one per request, moving on
+// through their linked lists. Addresses are converted straight to host
+// pointers, which works because everything the firmware hands the DMA is
+// static (see the Makefile). A byte written to UART3's THR is sent.
+const int kDmaChannels = 8;
+const uint32_t kDmaEnable = 1 << 0;
+const uint32_t kDmaSizeMask = 0xFFF;
+const int kDmaSwidthShift = 18;
+const uint32_t kDmaSi = 1 << 26;
+const uint32_t kDmaDi = 1 << 27;
+const uint32_t kDmaInt = 1u << 31;
+const uint32_t kDmaChannelEnable = 1 << 0;
+const uint32_t kDmaChannelItc = 1 << 15;
+
+LPC_GPDMACH_TypeDef dma_channels[kDmaChannels];
+uint64_t dma_transfers = 0;
+
+uint32_t* DmaAddress(uint32_t address) {
+    return (uint32_t*)(uintptr_t)address;
+}
+
+void UartSend(int uart, uint8_t byte);
+
+class GpdmaModel {
+  public:
+    // A peripheral has raised DMA request line |line|.
+    static void Request(int line) {
+        if (!(LPC_GPDMA->DMACConfig & kDmaEnable)) {
+            return;
+        }
+        for (int i = 0; i < kDmaChannels; i++) {
+            LPC_GPDMACH_TypeDef& ch = dma_channels[i];
+            if ((ch.DMACCConfig & kDmaChannelEnable)
+                    && (int)((ch.DMACCConfig >> 6) & 0x1F) == line) {
+                Transfer(i);
+                return;  // the request is cleared once a channel acts on it
+            }
+        }
+    }
+
+    // Whether a channel would act on a request on |line|.
+    static bool Waiting(int line) {
+        if (!(LPC_GPDMA->DMACConfig & kDmaEnable)) {
+            return false;
+        }
+        for (int i = 0; i < kDmaChannels; i++) {
+            const LPC_GPDMACH_TypeDef& ch = dma_channels[i];
+            if ((ch.DMACCConfig & kDmaChannelEnable)
+                    && (int)((ch.DMACCConfig >> 6) & 0x1F) == line) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool Line() {
+        return (LPC_GPDMA->DMACIntTCStat | LPC_GPDMA->DMACIntErrStat) != 0;
+    }
+
+  private:
+    static void Transfer(int i) {
+        LPC_GPDMACH_TypeDef& ch = dma_channels[i];
+        uint32_t width = ((ch.DMACCControl >> kDmaSwidthShift) & 7) ? 4 : 1;
+        if (DmaAddress(ch.DMACCDestAddr) == &LPC_UART3->THR) {
+            UartSend(3, *(const uint8_t*)DmaAddress(ch.DMACCSrcAddr));
+        } else if (width == 1) {
+            *(uint8_t*)DmaAddress(ch.DMACCDestAddr) = *(const uint8_t*)DmaAddress(ch.DMACCSrcAddr);
+        } else {
+            *DmaAddress(ch.DMACCDestAddr) = *DmaAddress(ch.DMACCSrcAddr);
+        }
+        dma_transfers++;
+        if (ch.DMACCControl & kDmaSi) {
+            ch.DMACCSrcAddr += width;
+        }
+        if (ch.DMACCControl & kDmaDi) {
+            ch.DMACCDestAddr += width;
+        }
+        uint32_t remaining = (ch.DMACCControl & kDmaSizeMask) - 1;
+        ch.DMACCControl = (ch.DMACCControl & ~kDmaSizeMask) | remaining;
+        if (remaining > 0) {
+            return;
+        }
+        if ((ch.DMACCControl & kDmaInt) && (ch.DMACCConfig & kDmaChannelItc)) {
+            LPC_GPDMA->DMACIntTCStat.Set(1 << i);
+        }
+        if (ch.DMACCLLI == 0) {
+            ch.DMACCConfig &= ~kDmaChannelEnable;
+            return;
+        }
+        const uint32_t* link = DmaAddress(ch.DMACCLLI);
+        ch.DMACCSrcAddr = link[0];
+        ch.DMACCDestAddr = link[1];
+        ch.DMACCLLI = link[2];
+        ch.DMACCControl = link[3];
+    }
+};
+
+/*********************************** TIMER2 ***********************************/
+
+// In counter mode, wired to the step output: Count() is called for every step
+// pulse. Only counts if it has been powered up and p30 connected to CAP2.0.
+// A match that resets the counter happens on the count after TC reaches the
+// match value (so MRn + 1 counts per match); one that doesn't happens as TC
+// reaches it.
+const uint32_t kTimIrAll = 0x3F;
+const uint32_t kTimTcrEnable = 1 << 0;
+const uint32_t kTimTcrReset = 1 << 1;
+const uint32_t kPconpTim2 = 1 << 22;
+const uint32_t kPinsel0Cap20 = 3 << 8;
+const uint32_t kDmaReqSelMat20 = 1 << 4;
+const int kDmaRequestMat20 = 12;
+
+class Timer2Model {
+  public:
+    static void Count() {
+        LPC_TIM_TypeDef* t = LPC_TIM2;
+        if (!(LPC_SC->PCONP & kPconpTim2)
+                || (LPC_PINCON->PINSEL0 & kPinsel0Cap20) != kPinsel0Cap20
+                || (t->CTCR & 3) == 0) {
+            return;
+        }
+        if (t->TCR & kTimTcrReset) {
+            t->TC = 0;
+            return;
+        }
+        if (!(t->TCR & kTimTcrEnable)) {
+            return;
+        }
+        // Both edges of a pulse count twice.
+        for (int edge = 0; edge < ((t->CTCR & 3) == 3 ? 2 : 1); edge++) {
+            const uint32_t match[4] = {t->MR0, t->MR1, t->MR2, t->MR3};
+            bool matched[4] = {false, false, false, false};
+            bool reset = false;
+            for (int n = 0; n < 4; n++) {
+                if ((t->MCR & (2 << (3 * n))) && t->TC == match[n]) {
+                    matched[n] = true;
+                    reset = true;
+                }
+            }
+            t->TC = reset ? 0 : t->TC + 1;
+            for (int n = 0; n < 4; n++) {
+                if (!matched[n] && !(t->MCR & (2 << (3 * n))) && t->TC == match[n]) {
+                    matched[n] = true;
+                }
+            }
+            for (int n = 0; n < 4; n++) {
+                if (!matched[n]) {
+                    continue;
+                }
+                if (t->MCR & (1 << (3 * n))) {
+                    t->IR.Set(1 << n);
+                }
+                if (t->MCR & (4 << (3 * n))) {
+                    t->TCR &= ~kTimTcrEnable;
+                }
+                if (n < 2 && (LPC_SC->DMAREQSEL & (kDmaReqSelMat20 << n))) {
+                    GpdmaModel::Request(kDmaRequestMat20 + n);
+                }
+            }
+        }
+    }
+
+    static bool Line() {return (LPC_TIM2->IR & kTimIrAll) != 0;}
+};
+
+/************************************ PWM1 ************************************/
+
+// PWM1 in single-edge mode with only MR0 (period), MR3 (p24) and MR4 (p23)
+// modelled. Writes to the match registers go to shadow registers, which are
+// loaded at the next MR0 match if their LER bit is set, except that the period
+// is loaded straight away because mbed's pwmout_period_us() restarts the
+// counter. A match interrupt is raised even when MR4 is 0 (i.e. the output is
+// held low), but only a non-zero MR4 produces a step pulse. MR3 only makes
+// pulses (counted separately); its interrupt isn't modelled.
+const uint32_t kPwmIrMr0 = 1 << 0;
+const uint32_t kPwmIrMr4 = 1 << 8;
+const uint32_t kPwmMcrMr0Interrupt = 1 << 0;
+const uint32_t kPwmMcrMr4Interrupt = 1 << 12;
+const uint32_t kPwmIrAll = 0x73F;
+const uint32_t kPwmLerMr0 = 1 << 0;
+const uint32_t kPwmLerMr3 = 1 << 3;
+const uint32_t kPwmLerMr4 = 1 << 4;
+
+class PwmModel : public EventSource {
+  public:
+    PwmModel() : period_start_(0), mr0_(0), mr3_(0), mr4_(0), matched3_(false),
+                 matched_(false), steps_(0), steps3_(0), lost_(0), last_step_(0),
+                 shortest_(kNever) {}
+
+    void Restart() {
+        mr0_ = LPC_PWM1->MR0;
+        mr3_ = LPC_PWM1->MR3;
+        mr4_ = LPC_PWM1->MR4;
+        LPC_PWM1->LER = 0;
+        period_start_ = now;
+        matched3_ = false;
+        matched_ = false;
+    }
+
+    uint64_t NextEvent() {
+        if (mr0_ == 0) {
+            return kNever;  // the counter never gets anywhere
+        }
+        uint64_t next = MatchTime(mr0_);
+        if (!matched_ && mr4_ <= mr0_) {
+            next = MatchTime(mr4_);
+        }
+        if (!matched3_ && mr3_ <= mr0_ && MatchTime(mr3_) < next) {
+            next = MatchTime(mr3_);
+        }
+        return next;
+    }
+
+    void Fire(uint64_t when) {
+        if (!matched3_ && mr3_ <= mr0_ && MatchTime(mr3_) <= when) {
+            matched3_ = true;
+            if (mr3_ > 0) {
+                steps3_++;
+            }
+        } else if (!matched_ && mr4_ <= mr0_) {
+            matched_ = true;
+            if (mr4_ > 0) {
+                steps_++;
+                Timer2Model::Count();  // the end of the pulse
+                if (last_step_ != 0 && when - last_step_ < shortest_) {
+                    shortest_ = when - last_step_;
+                }
+                last_step_ = when;
+            }
+            if (LPC_PWM1->MCR & kPwmMcrMr4Interrupt) {
+                if ((LPC_PWM1->IR & kPwmIrMr4) && mr4_ > 0) {
+                    lost_++;  // a step the last one hasn't been handled yet
+                }
+                LPC_PWM1->IR.Set(kPwmIrMr4);
+            }
+        } else {
+            if (LPC_PWM1->MCR & kPwmMcrMr0Interrupt) {
+                LPC_PWM1->IR.Set(kPwmIrMr0);
+            }
+            if (LPC_PWM1->LER & kPwmLerMr0) {
+                mr0_ = LPC_PWM1->MR0;
+            }
+            if (LPC_PWM1->LER & kPwmLerMr3) {
+                mr3_ = LPC_PWM1->MR3;
+            }
+            if (LPC_PWM1->LER & kPwmLerMr4) {
+                mr4_ = LPC_PWM1->MR4;
+            }
+            LPC_PWM1->LER = 0;
+            period_start_ = when;
+            matched3_ = false;
+            matched_ = false;
+        }
+    }
+
+    static bool Line() {return (LPC_PWM1->IR & kPwmIrAll) != 0;}
+
+    uint64_t steps() const {return steps_;}
+    uint64_t steps3() const {return steps3_;}
+    uint64_t lost() const {return lost_;}
+    uint64_t shortest() const {return shortest_;}
+    void ResetShortest() {shortest_ = kNever;}
+
+  private:
+    uint64_t MatchTime(uint32_t match) {
+        return period_start_ + match * kCyclesPerPclk;
+    }
+
+    uint64_t period_start_;
+    uint32_t mr0_;
+    uint32_t mr3_;
+    uint32_t mr4_;
+    bool matched3_;
+    bool matched_;  // MR4
+    uint64_t steps_;
+    uint64_t steps3_;
+    uint64_t lost_;
+    uint64_t last_step_;
+    uint64_t shortest_;
+};
+
+PwmModel pwm1;
+
+/*********************************** Ticker ***********************************/
+
+// mbed multiplexes every Ticker onto TIMER3.
+Ticker* tickers = NULL;
+bool ticker_irq = false;
+
+class TickerModel : public EventSource {
+  public:
+    uint64_t NextEvent() {
+        uint64_t earliest = kNever;
+        for (Ticker* t = tickers; t; t = t->link_) {
+            if (t->handler_ && t->next_ < earliest) {
+                earliest = t->next_;
+            }
+        }
+        return earliest;
+    }
+
+    void Fire(uint64_t when) {
+        for (Ticker* t = tickers; t; t = t->link_) {
+            if (t->handler_ && t->next_ <= when) {
+                t->next_ += t->interval_;
+                t->due_ = true;
+            }
+        }
+        ticker_irq = true;
+    }
+
+    static bool Line() {return ticker_irq;}
+
+    static void Vector() {
+        ticker_irq = false;
+        uint64_t overhead = kExceptionCycles;
+        for (Ticker* t = tickers; t; t = t->link_) {
+            if (t->due_) {
+                t->due_ = false;
+                CallProfiled(t->handler_, overhead + kMbedIrqWrapperCycles);
+                overhead = 0;
+            }
+        }
+    }
+};
+
+TickerModel ticker_model;
+
+/************************************* ADC ************************************/
+
+// Burst mode on channel 0 (p15), converting every 65 ADC clocks; the ADC clock
+// is PCLK_ADC / (CLKDIV + 1). The result is what SetAnalogIn() gave p15, less
+// SetBatterySag() if a step has been taken in the last millisecond.
+const uint32_t kPconpAdc = 1 << 12;
+const uint32_t kAdcrBurst = 1 << 16;
+const uint32_t kAdcrPdn = 1 << 21;
+const uint32_t kAdcDone = 0x80000000u;
+const uint32_t kAdcOverrun = 0x40000000u;
+const int kAdcClocksPerConversion = 65;
+
+std::map<int, float> analog_values;
+float battery_sag = 0.0f;
+
+class AdcModel : public EventSource {
+  public:
+    AdcModel() : next_(kNever), steps_(0), last_step_(0) {}
+
+    uint64_t NextEvent() {
+        const uint32_t on = kAdcrBurst | kAdcrPdn;
+        if (!(LPC_SC->PCONP & kPconpAdc) || (LPC_ADC->ADCR & on) != on) {
+            next_ = kNever;
+        } else if (next_ == kNever) {
+            next_ = now + ConversionCycles();  // just switched on
+        }
+        return next_;
+    }
+
+    void Fire(uint64_t when) {
+        if (StepCount() != steps_) {
+            steps_ = StepCount();
+            last_step_ = when;
+        }
+        float value = analog_values.count(p15) ? analog_values[p15] : 0.0f;
+        if (steps_ && when - last_step_ < FromMicroseconds(1000)) {
+            value -= battery_sag;
+        }
+        value = std::max(0.0f, std::min(1.0f, value));
+        uint32_t result = (uint32_t)(value * 4095.0f + 0.5f) << 4 | kAdcDone;
+        if (LPC_ADC->ADDR0.Peek() & kAdcDone) {
+            result |= kAdcOverrun;
+        }
+        LPC_ADC->ADDR0.Set(result);
+        next_ = when + ConversionCycles();
+    }
+
+    static bool Line() {
+        return (LPC_ADC->ADINTEN & 1) && (LPC_ADC->ADDR0.Peek() & kAdcDone);
+    }
+
+  private:
+    static uint64_t ConversionCycles() {
+        static const uint64_t kPclkDivider[4] = {4, 1, 2, 8};
+        uint64_t clkdiv = (LPC_ADC->ADCR >> 8) & 0xFF;
+        return kPclkDivider[(LPC_SC->PCLKSEL0 >> 24) & 3] * (clkdiv + 1)
+               * kAdcClocksPerConversion;
+    }
+
+    uint64_t next_;
+    uint64_t steps_;
+    uint64_t last_step_;
+};
+
+AdcModel adc_model;
+
+/************************************ UARTs ***********************************/
+
+struct Uart {
+    std::deque<uint8_t> rx;
+    std::deque<uint8_t> tx;
+    uint64_t next_drain;
+    uint64_t byte_cycles;
+    bool thre;  // transmit holding register empty interrupt
+    void (*rx_handler)();
+    void (*tx_handler)();
+};
+
+const int kUartIrqs[4] = {UART0_IRQn, UART1_IRQn, UART2_IRQn, UART3_IRQn};
+Uart uarts[4];
+TxHook tx_hook = NULL;
+uint64_t rx_overruns = 0;
+
+template <int N> bool UartLine() {
+    Uart& uart = uarts[N];
+    return (uart.rx_handler && !uart.rx.empty()) || (uart.tx_handler && uart.thre);
+}
+
+template <int N> void UartVector() {
+    Uart& uart = uarts[N];
+    uint64_t overhead = kExceptionCycles;
+    if (uart.rx_handler && !uart.rx.empty()) {
+        CallProfiled(uart.rx_handler, overhead + kMbedIrqWrapperCycles);
+        overhead = 0;
+    }
+    if (uart.tx_handler && uart.thre) {
+        uart.thre = false;  // reading the IIR clears it
+        CallProfiled(uart.tx_handler, overhead + kMbedIrqWrapperCycles);
+    } else if (overhead) {
+        Charge(overhead);
+    }
+}
+
+const IrqLine kUartLines[4] = {UartLine<0>, UartLine<1>, UartLine<2>, UartLine<3>};
+void (*const kUartVectors[4])() = {UartVector<0>, UartVector<1>, UartVector<2>, UartVector<3>};
+
+class UartModel : public EventSource {
+  public:
+    uint64_t NextEvent() {
+        uint64_t earliest = kNever;
+        for (int i = 0; i < 4; i++) {
+            if (!uarts[i].tx.empty() && uarts[i].next_drain < earliest) {
+                earliest = uarts[i].next_drain;
+            }
+        }
+        return earliest;
+    }
+
+    void Fire(uint64_t when) {
+        for (int i = 0; i < 4; i++) {
+            Uart& uart = uarts[i];
+            if (uart.tx.empty() || uart.next_drain != when) {
+                continue;
+            }
+            uint8_t byte = uart.tx.front();
+            uart.tx.pop_front();
+            if (tx_hook) {
+                tx_hook(i, byte, when);
+            }
+            if (uart.tx.empty()) {
+                uart.thre = true;
+            } else {
+                uart.next_drain += uart.byte_cycles;
+            }
+            return;
+        }
+    }
+};
+
+UartModel uart_model;
+
+// Adds |byte| to a UART's transmit FIFO, which must have room.
+void UartSend(int n, uint8_t byte) {
+    Uart& uart = uarts[n];
+    if (uart.tx.empty()) {
+        uart.next_drain = now + uart.byte_cycles;
+    }
+    uart.tx.push_back(byte);
+    uart.thre = false;
+}
+
+// With the FIFO and DMA mode on in UART3's FCR, its transmitter asks the DMA
+// for another byte whenever the FIFO has room.
+const uint32_t kUartFcrFifoEnable = 1 << 0;
+const uint32_t kUartFcrDmaMode = 1 << 3;
+const uint32_t kDmaReqSelMat30 = 1 << 6;
+const int kDmaRequestUart3Tx = 14;
+
+class UartDmaModel : public EventSource {
+  public:
+    uint64_t NextEvent() {
+        const uint32_t on = kUartFcrFifoEnable | kUartFcrDmaMode;
+        if ((LPC_UART3->FCR & on) != on || (LPC_SC->DMAREQSEL & kDmaReqSelMat30)
+                || uarts[3].tx.size() >= (size_t)kUartFifoSize
+                || !GpdmaModel::Waiting(kDmaRequestUart3Tx)) {
+            return kNever;
+        }
+        return now;
+    }
+
+    void Fire(uint64_t) {
+        GpdmaModel::Request(kDmaRequestUart3Tx);
+    }
+};
+
+UartDmaModel uart_dma_model;
+
+int UartForPin(PinName tx) {
+    switch (tx) {
+        case USBTX: return 0;
+        case p13: return 1;
+        case p28: return 2;
+        case p9: return 3;
+        default:
+            fprintf(stderr, "sim: no UART on pin %d\n", tx);
+            abort();
+    }
+}
+
+/************************************ Misc ************************************/
+
+std::map<int, int> pin_values;
+int bus_in_value = 0;
+int (*gyro_source)(uint64_t when) = NULL;
+
+/************************************ Flash ***********************************/
+
+// The last sector (see iap_constants.h), and whether it's been prepared for
+// the next copy or erase.
+uint8_t flash_sector[kFlashSectorSize];
+bool flash_erased = false;
+bool flash_prepared = false;
+const int kFlashSector = 29;
+// Roughly how long the boot ROM takes (datasheet section 32.9).
+const uint64_t kEraseCycles = kCoreClockHz / 10;
+const uint64_t kCopyCycles = kCoreClockHz / 1000;
+
+// IAP status codes.
+enum {
+    kIapSuccess = 0,
+    kIapInvalidCommand = 1,
+    kIapDstAddrError = 3,
+    kIapDstAddrNotMapped = 5,
+    kIapCountError = 6,
+    kIapInvalidSector = 7,
+    kIapNotPrepared = 9
+};
+
+int IapCommand(uint32_t* command) {
+    FlashSector();  // in case it's never been read
+    switch (command[0]) {
+        case 50:  // prepare
+            if (command[1] != (uint32_t)kFlashSector || command[2] != (uint32_t)kFlashSector) {
+                return kIapInvalidSector;
+            }
+            flash_prepared = true;
+            return kIapSuccess;
+        case 52:  // erase
+            if (command[1] != (uint32_t)kFlashSector || command[2] != (uint32_t)kFlashSector) {
+                return kIapInvalidSector;
+            }
+            if (!flash_prepared) {
+                return kIapNotPrepared;
+            }
+            flash_prepared = false;
+            Charge(kEraseCycles);
+            memset(flash_sector, 0xFF, kFlashSectorSize);
+            return kIapSuccess;
+        case 51: {  // copy RAM to flash
+            uintptr_t offset = (uintptr_t)command[1] - (uintptr_t)flash_sector;
+            uint32_t count = command[3];
+            if (offset % 256 != 0) {
+                return kIapDstAddrError;
+            }
+            if (count != 256 && count != 512 && count != 1024 && count != 4096) {
+                return kIapCountError;
+            }
+            if (offset >= kFlashSectorSize || offset + count > kFlashSectorSize) {
+                return kIapDstAddrNotMapped;
+            }
+            if (!flash_prepared) {
+                return kIapNotPrepared;
+            }
+            flash_prepared = false;
+            Charge(kCopyCycles);
+            // Programming can only clear bits.
+            const uint8_t* source = (const uint8_t*)(uintptr_t)command[2];
+            for (uint32_t i = 0; i < count; i++) {
+                flash_sector[offset + i] &= source[i];
+            }
+            return kIapSuccess;
+        }
+        default:
+            return kIapInvalidCommand;
+    }
+}
+
+/******************************** GPIO interrupts *****************************/
+
+// mbed puts every InterruptIn on the EINT3 interrupt.
+InterruptIn* interrupt_ins = NULL;
+
+void PulsePin(int pin) {
+    for (InterruptIn* in = interrupt_ins; in; in = in->link_) {
+        if (in->pin_ == pin && in->rise_handler_) {
+            in->due_ = true;
+        }
+    }
+}
+
+bool GpioLine() {
+    for (InterruptIn* in = interrupt_ins; in; in = in->link_) {
+        if (in->due_) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void GpioVector() {
+    uint64_t overhead = kExceptionCycles;
+    for (InterruptIn* in = interrupt_ins; in; in = in->link_) {
+        if (in->due_) {
+            in->due_ = false;
+            CallProfiled(in->rise_handler_, overhead + kMbedIrqWrapperCycles);
+            overhead = 0;
+        }
+    }
+}
+
+/*********************************** MPU6050 **********************************/
+
+// Just enough of the register map for the firmware: the sample rate, a FIFO
+// that only ever has Z in it, and the data ready interrupt on p29.
+const uint8_t kGyroSmplrtDiv = 0x19;
+const uint8_t kGyroConfig = 0x1A;
+const uint8_t kGyroFifoEn = 0x23;
+const uint8_t kGyroFifoEnZg = 1 << 4;
+const uint8_t kGyroIntEnable = 0x38;
+const uint8_t kGyroDataRdyEn = 1 << 0;
+const uint8_t kGyroZoutH = 0x47;
+const uint8_t kGyroZoutL = 0x48;
+const uint8_t kGyroUserCtrl = 0x6A;
+const uint8_t kGyroUserCtrlFifoEn = 1 << 6;
+const uint8_t kGyroUserCtrlFifoReset = 1 << 2;
+const uint8_t kGyroPwrMgmt1 = 0x6B;
+const uint8_t kGyroSleep = 1 << 6;
+const uint8_t kGyroFifoCountH = 0x72;
+const uint8_t kGyroFifoCountL = 0x73;
+const uint8_t kGyroFifoRw = 0x74;
+const uint8_t kGyroWhoAmI = 0x75;
+const int kGyroFifoSize = 1024;
+const int kGyroIntPin = p29;
+
+// Plain data, so it doesn't matter when its constructor would have run. It
+// starts awake; the library's constructor would have woken it anyway.
+struct Mpu6050 {
+    uint8_t registers[128];
+    uint8_t pointer;
+    int16_t latest;
+    uint8_t fifo[kGyroFifoSize];
+    int fifo_head;
+    int fifo_count;
+    uint64_t next_sample;
+    uint64_t samples;
+    uint64_t fifo_lost;  // in bytes
+};
+
+Mpu6050 mpu6050;
+uint64_t i2c_busy_cycles = 0;
+
+uint64_t GyroSamplePeriod() {
+    int dlpf = mpu6050.registers[kGyroConfig] & 7;
+    uint64_t output_rate = (dlpf == 0 || dlpf == 7) ? 8000 : 1000;
+    return kCoreClockHz / output_rate * (1 + mpu6050.registers[kGyroSmplrtDiv]);
+}
+
+void PushFifo(uint8_t byte) {
+    Mpu6050& m = mpu6050;
+    if (m.fifo_count == kGyroFifoSize) {
+        // Full: the oldest byte goes.
+        m.fifo_head = (m.fifo_head + 1) % kGyroFifoSize;
+        m.fifo_count--;
+        m.fifo_lost++;
+    }
+    m.fifo[(m.fifo_head + m.fifo_count) % kGyroFifoSize] = byte;
+    m.fifo_count++;
+}
+
+uint8_t PopFifo() {
+    Mpu6050& m = mpu6050;
+    if (m.fifo_count == 0) {
+        return 0;
+    }
+    uint8_t byte = m.fifo[m.fifo_head];
+    m.fifo_head = (m.fifo_head + 1) % kGyroFifoSize;
+    m.fifo_count--;
+    return byte;
+}
+
+void WriteGyroRegister(uint8_t reg, uint8_t value) {
+    if (reg == kGyroUserCtrl && (value & kGyroUserCtrlFifoReset)) {
+        mpu6050.fifo_head = 0;
+        mpu6050.fifo_count = 0;
+        value &= ~kGyroUserCtrlFifoReset;
+    }
+    mpu6050.registers[reg & 0x7F] = value;
+}
+
+uint8_t ReadGyroRegister(uint8_t reg) {
+    Mpu6050& m = mpu6050;
+    switch (reg) {
+        case kGyroFifoCountH: return m.fifo_count >> 8;
+        case kGyroFifoCountL: return m.fifo_count & 0xFF;
+        case kGyroFifoRw: return PopFifo();
+        case kGyroWhoAmI: return 0x68;
+        case kGyroZoutH: return (uint16_t)m.latest >> 8;
+        case kGyroZoutL: return m.latest & 0xFF;
+        default: return m.registers[reg & 0x7F];
+    }
+}
+
+class Mpu6050Model : public EventSource {
+  public:
+    uint64_t NextEvent() {
+        return (mpu6050.registers[kGyroPwrMgmt1] & kGyroSleep) ? kNever : mpu6050.next_sample;
+    }
+
+    void Fire(uint64_t when) {
+        Mpu6050& m = mpu6050;
+        int rate = gyro_source ? gyro_source(when) : 0;
+        m.latest = (int16_t)std::max(-32768, std::min(32767, rate));
+        if ((m.registers[kGyroUserCtrl] & kGyroUserCtrlFifoEn)
+                && (m.registers[kGyroFifoEn] & kGyroFifoEnZg)) {
+            m.samples++;
+            PushFifo((uint16_t)m.latest >> 8);
+            PushFifo(m.latest & 0xFF);
+        }
+        if (m.registers[kGyroIntEnable] & kGyroDataRdyEn) {
+            PulsePin(kGyroIntPin);
+        }
+        m.next_sample = when + GyroSamplePeriod();
+    }
+};
+
+Mpu6050Model mpu6050_model;
+
+// A write sets the register pointer from its first byte, then writes the rest
+// to consecutive registers; a read carries on from the pointer. FIFO_R_W
+// doesn't move the pointer, so a burst read of it empties the FIFO.
+bool GyroWrite(int address, const char* data, int length) {
+    if (address != MPU6050_ADDRESS * 2) {
+        return false;
+    }
+    for (int i = 0; i < length; i++) {
+        if (i == 0) {
+            mpu6050.pointer = data[0] & 0x7F;
+        } else {
+            WriteGyroRegister(mpu6050.pointer, data[i]);
+            mpu6050.pointer = (mpu6050.pointer + 1) & 0x7F;
+        }
+    }
+    return true;
+}
+
+bool GyroRead(int address, char* data, int length) {
+    if (address != MPU6050_ADDRESS * 2) {
+        return false;
+    }
+    for (int i = 0; i < length; i++) {
+        data[i] = ReadGyroRegister(mpu6050.pointer);
+        if (mpu6050.pointer != kGyroFifoRw) {
+            mpu6050.pointer = (mpu6050.pointer + 1) & 0x7F;
+        }
+    }
+    return true;
+}
+
+// Start, address, the bytes (each with its acknowledge bit) and, unless the
+// next transaction follows straight on, stop.
+void ChargeI2c(int hz, int bytes, bool repeated) {
+    uint64_t bits = 1 + 9 * (1 + bytes) + (repeated ? 0 : 1);
+    uint64_t cycles = bits * kCoreClockHz / hz;
+    i2c_busy_cycles += cycles;
+    Charge(cycles);
+}
+
+}  // namespace
+
+EventSource::EventSource() {
+    Sources().push_back(this);
+}
+
+EventSource::~EventSource() {
+    std::vector<EventSource*>& sources = Sources();
+    sources.erase(std::remove(sources.begin(), sources.end(), this), sources.end());
+}
+
+uint64_t Now() {
+    return now;
+}
+
+bool InIsr() {
+    return in_isr;
+}
+
+void Charge(uint64_t cycles) {
+    uint64_t remaining = cycles;
+    for (;;) {
+        EventSource* source;
+        uint64_t when = Earliest(&source);
+        if (when == kNever || when > now + remaining) {
+            break;
+        }
+        if (when > now) {
+            remaining -= when - now;
+            now = when;
+        }
+        source->Fire(when);
+        // Outside an ISR, the foreground is preempted; its operation finishes
+        // once the handlers are done.
+        DispatchPending();
+    }
+    now += remaining;
+}
+
+void WaitForEvent() {
+    if (in_isr) {
+        return;
+    }
+    while (HighestPending() < 0) {
+        EventSource* source;
+        uint64_t when = Earliest(&source);
+        if (when == kNever) {
+            fprintf(stderr, "sim: WFI with nothing left that could wake it\n");
+            abort();
+        }
+        if (when > now) {
+            now = when;
+        }
+        source->Fire(when);
+    }
+    DispatchPending();
+}
+
+void SetVector(int irq, void (*vector)()) {
+    nvic[irq].vector = vector;
+    nvic[irq].internal = false;
+}
+
+void SetInternalVector(int irq, void (*vector)()) {
+    nvic[irq].vector = vector;
+    nvic[irq].internal = true;
+}
+
+void SetIrqLine(int irq, IrqLine line) {
+    nvic[irq].line = line;
+}
+
+void EnableIrq(int irq, bool enabled) {
+    nvic[irq].enabled = enabled;
+    if (enabled) {
+        DispatchPending();
+    }
+}
+
+void SetPending(int irq) {
+    nvic[irq].pending = true;
+    DispatchPending();
+}
+
+void MaskInterrupts(bool mask) {
+    masked = mask;
+    if (!mask) {
+        DispatchPending();
+    }
+}
+
+bool InterruptsMasked() {
+    return masked;
+}
+
+void DispatchPending() {
+    if (in_isr || masked) {
+        return;
+    }
+    int irq;
+    while ((irq = HighestPending()) >= 0) {
+        uint64_t start = now;
+        in_isr = true;
+        nvic[irq].pending = false;
+        if (nvic[irq].internal) {
+            nvic[irq].vector();  // charges its own entry overhead
+        } else {
+            CallProfiled(nvic[irq].vector, kExceptionCycles);
+        }
+        in_isr = false;
+        isr_cycles += now - start;
+    }
+}
+
+void CallProfiled(void (*handler)(), uint64_t overhead) {
+    uint64_t start = now;
+    Charge(overhead);
+    handler();
+    uint64_t cycles = now - start;
+    HandlerStats& s = stats[handler];
+    s.calls++;
+    s.cycles += cycles;
+    if (cycles > s.max_cycles) {
+        s.max_cycles = cycles;
+    }
+}
+
+const HandlerStats* StatsFor(void (*handler)()) {
+    std::map<void (*)(), HandlerStats>::const_iterator it = stats.find(handler);
+    return it == stats.end() ? NULL : &it->second;
+}
+
+uint64_t IsrCycles() {return isr_cycles;}
+uint64_t StepCount() {return pwm1.steps();}
+uint64_t RightStepCount() {return pwm1.steps3();}
+uint64_t LostStepInterrupts() {return pwm1.lost();}
+uint64_t RxOverruns() {return rx_overruns;}
+uint64_t GyroSamples() {return mpu6050.samples;}
+uint64_t GyroFifoLost() {return mpu6050.fifo_lost / 2;}
+uint64_t I2cBusyCycles() {return i2c_busy_cycles;}
+uint64_t ShortestStepPeriod() {return pwm1.shortest();}
+void ResetStepPeriod() {pwm1.ResetShortest();}
+
+int PinValue(int pin) {return pin_values[pin];}
+
+void SetAnalogIn(int pin, float value) {analog_values[pin] = value;}
+void SetBatterySag(float sag) {battery_sag = sag;}
+void SetBusIn(int value) {bus_in_value = value;}
+void SetGyroSource(int (*source)(uint64_t when)) {gyro_source = source;}
+void SetTxHook(TxHook hook) {tx_hook = hook;}
+
+void Receive(int uart, uint8_t byte) {
+    if (uarts[uart].rx.size() >= (size_t)kUartFifoSize) {
+        rx_overruns++;
+        return;
+    }
+    uarts[uart].rx.push_back(byte);
+}
+
+uint64_t ByteCycles(int uart) {
+    return uarts[uart].byte_cycles;
+}
+
+void Iap(uint32_t* command, uint32_t* result) {
+    result[0] = IapCommand(command);
+}
+
+uint8_t* FlashSector() {
+    if (!flash_erased) {
+        memset(flash_sector, 0xFF, kFlashSectorSize);
+        flash_erased = true;
+    }
+    return flash_sector;
+}
+
+}  // namespace sim
+
+/************************ The stand-in mbed interfaces ************************/
+
+using sim::Charge;
+
+namespace {
+
+LPC_PWM_TypeDef pwm1_registers;
+LPC_TIM_TypeDef tim2_registers;
+LPC_SC_TypeDef sc_registers;
+LPC_PINCON_TypeDef pincon_registers;
+LPC_GPDMA_TypeDef gpdma_registers;
+LPC_ADC_TypeDef adc_registers;
+LPC_UART_TypeDef uart3_registers;
+DWT_Type dwt_registers;
+CoreDebug_Type core_debug_registers;
+
+// Installed before any of the firmware's static constructors run, since PWM1
+// and TIMER2 are always there.
+struct PeripheralIrqLines {
+    PeripheralIrqLines() {
+        sim::SetIrqLine(PWM1_IRQn, sim::PwmModel::Line);
+        sim::SetIrqLine(TIMER2_IRQn, sim::Timer2Model::Line);
+        sim::SetIrqLine(DMA_IRQn, sim::GpdmaModel::Line);
+        sim::SetIrqLine(ADC_IRQn, sim::AdcModel::Line);
+    }
+} peripheral_irq_lines;
+
+const uint64_t kPwmTicksPerMicrosecond = sim::kCoreClockHz / sim::kCyclesPerPclk / 1000000;
+
+}  // namespace
+
+LPC_PWM_TypeDef* const LPC_PWM1 = &pwm1_registers;
+LPC_TIM_TypeDef* const LPC_TIM2 = &tim2_registers;
+LPC_SC_TypeDef* const LPC_SC = &sc_registers;
+LPC_PINCON_TypeDef* const LPC_PINCON = &pincon_registers;
+LPC_GPDMA_TypeDef* const LPC_GPDMA = &gpdma_registers;
+LPC_ADC_TypeDef* const LPC_ADC = &adc_registers;
+LPC_UART_TypeDef* const LPC_UART3 = &uart3_registers;
+uint32_t SystemCoreClock = (uint32_t)sim::kCoreClockHz;
+LPC_GPDMACH_TypeDef* const LPC_GPDMACH0 = &sim::dma_channels[0];
+LPC_GPDMACH_TypeDef* const LPC_GPDMACH1 = &sim::dma_channels[1];
+LPC_GPDMACH_TypeDef* const LPC_GPDMACH2 = &sim::dma_channels[2];
+LPC_GPDMACH_TypeDef* const LPC_GPDMACH3 = &sim::dma_channels[3];
+LPC_GPDMACH_TypeDef* const LPC_GPDMACH4 = &sim::dma_channels[4];
+LPC_GPDMACH_TypeDef* const LPC_GPDMACH5 = &sim::dma_channels[5];
+LPC_GPDMACH_TypeDef* const LPC_GPDMACH6 = &sim::dma_channels[6];
+LPC_GPDMACH_TypeDef* const LPC_GPDMACH7 = &sim::dma_channels[7];
+DWT_Type* const DWT = &dwt_registers;
+CoreDebug_Type* const CoreDebug = &core_debug_registers;
+
+void wait(float s) {Charge((uint64_t)(s * sim::kCoreClockHz));}
+void wait_ms(int ms) {Charge(sim::FromMicroseconds(ms * 1000));}
+void wait_us(int us) {Charge(sim::FromMicroseconds(us));}
+uint32_t us_ticker_read() {return (uint32_t)(sim::Now() / (sim::kCoreClockHz / 1000000));}
+
+void DigitalOut::write(int value) {
+    Charge(sim::kDigitalOutCycles);
+    value_ = value ? 1 : 0;
+    sim::pin_values[pin_] = value_;
+}
+
+BusIn::BusIn(PinName, PinName, PinName, PinName, PinName, PinName, PinName, PinName) {}
+
+int BusIn::read() {
+    Charge(sim::kBusInCycles);
+    return sim::bus_in_value;
+}
+
+float AnalogIn::read() {
+    Charge(sim::kAnalogInReadCycles);
+    std::map<int, float>::const_iterator it = sim::analog_values.find(pin_);
+    return it == sim::analog_values.end() ? 0.0f : it->second;
+}
+
+unsigned short AnalogIn::read_u16() {
+    return (unsigned short)(read() * 65535.0f);
+}
+
+PwmOut::PwmOut(PinName pin) {
+    switch (pin) {
+        case p26: match_ = &LPC_PWM1->MR1; channel_ = 1; break;
+        case p25: match_ = &LPC_PWM1->MR2; channel_ = 2; break;
+        case p24: match_ = &LPC_PWM1->MR3; channel_ = 3; break;
+        case p23: match_ = &LPC_PWM1->MR4; channel_ = 4; break;
+        case p22: match_ = &LPC_PWM1->MR5; channel_ = 5; break;
+        case p21: match_ = &LPC_PWM1->MR6; channel_ = 6; break;
+        default:
+            fprintf(stderr, "sim: no PWM on pin %d\n", pin);
+            abort();
+    }
+}
+
+void PwmOut::write(float value) {
+    Charge(sim::kPwmWriteCycles);
+    if (value < 0.0f) {
+        value = 0.0f;
+    } else if (value > 1.0f) {
+        value = 1.0f;
+    }
+    uint32_t v = (uint32_t)((float)LPC_PWM1->MR0 * value);
+    if (v == LPC_PWM1->MR0) {
+        v++;  // as mbed does, to avoid a one-cycle dropout
+    }
+    *match_ = v;
+    LPC_PWM1->LER |= 1 << channel_;
+}
+
+float PwmOut::read() {
+    if (LPC_PWM1->MR0 == 0) {
+        return 0.0f;
+    }
+    float v = (float)*match_ / (float)LPC_PWM1->MR0;
+    return v > 1.0f ? 1.0f : v;
+}
+
+void PwmOut::period(float seconds) {period_us((int)(seconds * 1000000.0f));}
+void PwmOut::period_ms(int ms) {period_us(ms * 1000);}
+
+void PwmOut::period_us(int us) {
+    Charge(sim::kPwmPeriodCycles);
+    uint32_t ticks = kPwmTicksPerMicrosecond * us;
+    if (LPC_PWM1->MR0 > 0) {
+        // Scale the pulse width to preserve the duty ratio.
+        *match_ = (uint32_t)((uint64_t)*match_ * ticks / LPC_PWM1->MR0);
+    }
+    LPC_PWM1->MR0 = ticks;
+    sim::pwm1.Restart();
+}
+
+void PwmOut::pulsewidth(float seconds) {pulsewidth_us((int)(seconds * 1000000.0f));}
+void PwmOut::pulsewidth_ms(int ms) {pulsewidth_us(ms * 1000);}
+
+void PwmOut::pulsewidth_us(int us) {
+    Charge(sim::kPwmWriteCycles);
+    uint32_t v = kPwmTicksPerMicrosecond * us;
+    if (v == LPC_PWM1->MR0) {
+        v++;
+    }
+    *match_ = v;
+    LPC_PWM1->LER |= 1 << channel_;
+}
+
+Serial::Serial(PinName tx, PinName) : uart_(sim::UartForPin(tx)) {
+    baud(9600);
+    sim::SetIrqLine(sim::kUartIrqs[uart_], sim::kUartLines[uart_]);
+}
+
+void Serial::baud(int baudrate) {
+    // Start bit, eight data bits, stop bit.
+    sim::uarts[uart_].byte_cycles = sim::kCoreClockHz * 10 / baudrate;
+}
+
+int Serial::getc() {
+    Charge(sim::kSerialCallCycles);
+    sim::Uart& uart = sim::uarts[uart_];
+    while (uart.rx.empty()) {
+        if (sim::InIsr()) {
+            Charge(uart.byte_cycles);
+        } else {
+            sim::WaitForEvent();
+        }
+    }
+    int c = uart.rx.front();
+    uart.rx.pop_front();
+    return c;
+}
+
+int Serial::putc(int c) {
+    Charge(sim::kSerialCallCycles);
+    sim::Uart& uart = sim::uarts[uart_];
+    while (uart.tx.size() >= (size_t)sim::kUartFifoSize) {
+        // Blocks until the shift register takes the next byte.
+        uint64_t n = sim::Now();
+        Charge(uart.next_drain > n ? uart.next_drain - n : 0);
+    }
+    sim::UartSend(uart_, (uint8_t)c);
+    return c;
+}
+
+int Serial::readable() {
+    Charge(sim::kSerialCallCycles);
+    return !sim::uarts[uart_].rx.empty();
+}
+
+int Serial::writeable() {
+    Charge(sim::kSerialCallCycles);
+    return sim::uarts[uart_].tx.size() < (size_t)sim::kUartFifoSize;
+}
+
+void Serial::attach(void (*fptr)(), IrqType type) {
+    sim::Uart& uart = sim::uarts[uart_];
+    if (type == RxIrq) {
+        uart.rx_handler = fptr;
+    } else {
+        uart.tx_handler = fptr;
+    }
+    sim::SetInternalVector(sim::kUartIrqs[uart_], sim::kUartVectors[uart_]);
+    sim::EnableIrq(sim::kUartIrqs[uart_], true);
+}
+
+Ticker::Ticker() : next_(0), interval_(0), handler_(NULL), due_(false), link_(sim::tickers) {
+    sim::tickers = this;
+}
+
+Ticker::~Ticker() {
+    for (Ticker** t = &sim::tickers; *t; t = &(*t)->link_) {
+        if (*t == this) {
+            *t = link_;
+            break;
+        }
+    }
+}
+
+void Ticker::attach(void (*fptr)(), float t) {
+    attach_us(fptr, (unsigned int)(t * 1000000.0f));
+}
+
+void Ticker::attach_us(void (*fptr)(), unsigned int t) {
+    interval_ = sim::FromMicroseconds(t);
+    next_ = sim::Now() + interval_;
+    handler_ = fptr;
+    due_ = false;
+    sim::SetIrqLine(TIMER3_IRQn, sim::TickerModel::Line);
+    sim::SetInternalVector(TIMER3_IRQn, sim::TickerModel::Vector);
+    sim::EnableIrq(TIMER3_IRQn, true);
+}
+
+void Ticker::detach() {
+    handler_ = NULL;
+    due_ = false;
+}
+
+InterruptIn::InterruptIn(PinName pin)
+        : pin_(pin), rise_handler_(NULL), due_(false), link_(sim::interrupt_ins) {
+    sim::interrupt_ins = this;
+}
+
+InterruptIn::~InterruptIn() {
+    for (InterruptIn** in = &sim::interrupt_ins; *in; in = &(*in)->link_) {
+        if (*in == this) {
+            *in = link_;
+            break;
+        }
+    }
+}
+
+void InterruptIn::rise(void (*fptr)()) {
+    rise_handler_ = fptr;
+    sim::SetIrqLine(EINT3_IRQn, sim::GpioLine);
+    sim::SetInternalVector(EINT3_IRQn, sim::GpioVector);
+    sim::EnableIrq(EINT3_IRQn, true);
+}
+
+int I2C::read(int address, char* data, int length, bool repeated) {
+    bool ack = sim::GyroRead(address, data, length);
+    sim::ChargeI2c(hz_, ack ? length : 0, repeated);
+    return ack ? 0 : 1;
+}
+
+int I2C::write(int address, const char* data, int length, bool repeated) {
+    bool ack = sim::GyroWrite(address, data, length);
+    sim::ChargeI2c(hz_, ack ? length : 0, repeated);
+    return ack ? 0 : 1;
+}
+
+// The real constructor takes the MPU6050 out of sleep, which the model starts
+// out of anyway.
+MPU6050::MPU6050(PinName sda, PinName scl) : connection(sda, scl) {}
+
+bool MPU6050::testConnection() {
+    return read(0x75) == (MPU6050_ADDRESS & 0xFE);
+}
+
+void MPU6050::write(char address, char data) {
+    char bytes[2] = {address, data};
+    connection.write(MPU6050_ADDRESS * 2, bytes, 2);
+}
+
+char MPU6050::read(char address) {
+    char data;
+    read(address, &data, 1);
+    return data;
+}
+
+void MPU6050::read(char address, char* data, int length) {
+    connection.write(MPU6050_ADDRESS * 2, &address, 1, true);
+    connection.read(MPU6050_ADDRESS * 2, data, length);
+}
\ No newline at end of file
@@ -0,0 +1,130 @@
+/* sim.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// The virtual clock behind the host build. Nothing in here is compiled into
+// the firmware that goes on the robot -- it exists so that the real firmware
+// sources can be linked against the stand-in mbed.h in this directory and run
+// on a Linux box, with time advancing deterministically.
+//
+// Time is measured in LPC1768 core clock cycles. It only ever moves forward
+// when the firmware does something that would take time on the real mbed (a
+// HAL call, an interrupt entry, a WFI); each of those charges a fixed number of
+// cycles from the cost table in sim.cpp. Whilst time moves forward, peripheral
+// events (PWM matches, ticker expiry, serial bytes arriving) are fired in
+// order, and pending interrupts are dispatched to the firmware's handlers as
+// they would be by the NVIC (no nesting, lowest IRQ number first).
+
+#ifndef JDH_16_17_RASPI3_HOST_SIM_H_
+#define JDH_16_17_RASPI3_HOST_SIM_H_
+
+#include <stdint.h>
+
+namespace sim {
+
+// The mbed runs the core at 96 MHz and the peripherals at CCLK/4.
+const uint64_t kCoreClockHz = 96000000;
+const uint64_t kCyclesPerPclk = 4;
+const uint64_t kNever = ~(uint64_t)0;
+
+// Thrown by the bench (from inside an event) once it has finished with the
+// firmware, to unwind out of main()'s infinite loop.
+struct Finished {};
+
+// Something that does things at known points in virtual time. Sources register
+// themselves on construction, and the engine always fires the earliest one.
+class EventSource {
+  public:
+    EventSource();
+    virtual ~EventSource();
+    // The virtual time of the next event, or kNever if there isn't one.
+    virtual uint64_t NextEvent() = 0;
+    // Called with the time returned by NextEvent() once it is reached.
+    virtual void Fire(uint64_t when) = 0;
+};
+
+// Cumulative cost of one interrupt handler.
+struct HandlerStats {
+    uint64_t calls;
+    uint64_t cycles;
+    uint64_t max_cycles;
+};
+
+// A byte leaving one of the UARTs (0 = USB serial, 3 = p9/p10).
+typedef void (*TxHook)(int uart, uint8_t byte, uint64_t when);
+
+uint64_t Now();
+inline double ToSeconds(uint64_t cycles) {return (double)cycles / kCoreClockHz;}
+inline uint64_t FromMicroseconds(uint64_t us) {return us * (kCoreClockHz / 1000000);}
+
+// Account for an operation taking |cycles|, firing any events that fall due
+// (and, outside an ISR, servicing the interrupts they raise).
+void Charge(uint64_t cycles);
+// Sleep until the next event, then service it.
+void WaitForEvent();
+bool InIsr();
+
+// NVIC model, used by the CMSIS stand-ins in mbed.h.
+typedef bool (*IrqLine)();
+void SetVector(int irq, void (*vector)());
+// Installs a handler belonging to the stand-in HAL itself (e.g. the mbed
+// Serial dispatcher); the firmware can still replace it with SetVector().
+void SetInternalVector(int irq, void (*vector)());
+void SetIrqLine(int irq, IrqLine line);
+void EnableIrq(int irq, bool enabled);
+// Pends an interrupt from software, whether or not its line is asserted.
+void SetPending(int irq);
+void MaskInterrupts(bool masked);
+bool InterruptsMasked();
+void DispatchPending();
+// Runs an interrupt handler, charging |overhead| cycles for getting to it, and
+// adds the total to that handler's statistics.
+void CallProfiled(void (*handler)(), uint64_t overhead);
+
+// Statistics gathered since start-up.
+const HandlerStats* StatsFor(void (*handler)());
+uint64_t IsrCycles();
+// PWM1 channel 4 (p23, the step clock).
+uint64_t StepCount();
+// Step pulses on p24 (PWM1 channel 3, the right wheel's clock with
+// SEPARATE_STEP_CLOCKS).
+uint64_t RightStepCount();
+uint64_t LostStepInterrupts();
+uint64_t ShortestStepPeriod();  // in cycles, since the last ResetStepPeriod()
+void ResetStepPeriod();
+// Bytes that arrived when a UART's receive FIFO was already full.
+uint64_t RxOverruns();
+// Samples the MPU6050 has put in its FIFO, and how many of them were pushed
+// out before they could be read.
+uint64_t GyroSamples();
+uint64_t GyroFifoLost();
+// Time spent with the I2C bus busy.
+uint64_t I2cBusyCycles();
+
+// What the firmware last wrote to a DigitalOut on |pin|.
+int PinValue(int pin);
+
+// Environment the firmware sees.
+void SetAnalogIn(int pin, float value);
+// How far p15 drops whilst the motors are taking steps, as a fraction.
+void SetBatterySag(float sag);
+void SetBusIn(int value);
+void SetGyroSource(int (*source)(uint64_t when));
+void SetTxHook(TxHook hook);
+// Puts a byte in a UART's receive FIFO, as if it had just finished arriving.
+void Receive(int uart, uint8_t byte);
+uint64_t ByteCycles(int uart);
+
+// The IAP routines in the boot ROM (see iap_constants.h), which act on a
+// stand-in for the last sector of flash. It starts off erased.
+const uint32_t kFlashSectorSize = 0x8000;
+void Iap(uint32_t* command, uint32_t* result);
+uint8_t* FlashSector();
+
+}  // namespace sim
+
+#endif  // JDH_16_17_RASPI3_HOST_SIM_H_
\ No newline at end of file
@@ -0,0 +1,132 @@
+/* telemetry_csv.cpp
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// Turns the telemetry frames from p9 (see telemetry.h) into CSV, one row per
+// frame, for a spreadsheet or a plotting script. Capture them on the Pi with
+// something like
+//     stty -F /dev/ttyUSB0 115200 raw && cat /dev/ttyUSB0 > run.bin
+// or from the bench with -T.
+//
+// Usage: telemetry_csv [capture]
+// Reads the capture (or standard input) and writes CSV to standard output.
+// Times are in ms from the first frame, and the battery in volts at p15;
+// everything else is as the robot sent it. Anything that isn't a whole frame
+// with a good CRC is skipped; how many sync bytes that happened at, and how
+// many frames the robot didn't send (the gaps in the sequence numbers), are
+// counted on standard error at the end.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "frames.h"
+#include "telemetry.h"
+
+namespace {
+
+const char* const kCommandNames[] = {
+    "none", "forward", "backward", "long_distance", "left", "right", "arc_left",
+    "arc_right"
+};
+
+// The CRC-8 of |length| bytes, as in frames.h.
+uint8_t FrameCrc(const uint8_t* bytes, int length) {
+    uint8_t crc = 0;
+    for (int i = 0; i < length; i++) {
+        crc ^= bytes[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+uint32_t Read16(const uint8_t* bytes) {
+    return bytes[0] | bytes[1] << 8;
+}
+
+uint32_t Read32(const uint8_t* bytes) {
+    return Read16(bytes) | Read16(bytes + 2) << 16;
+}
+
+double Volts(uint32_t level) {
+    return level * 3.3 / 65535;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc > 2) {
+        fprintf(stderr, "usage: telemetry_csv [capture]\n");
+        return 2;
+    }
+    FILE* in = stdin;
+    if (argc == 2) {
+        in = fopen(argv[1], "rb");
+        if (!in) {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+
+    printf("time_ms,seq,subsample,steps_gone,steps_left,pwm_period,gyro_z,"
+           "detector,battery_v,sag_v,command,queued,collision,ignoring,"
+           "low_power,turn_check\n");
+    std::vector<uint8_t> capture;
+    int c;
+    while ((c = getc(in)) != EOF) {
+        capture.push_back((uint8_t)c);
+    }
+
+    long frames = 0;
+    long bad = 0;
+    long missed = 0;
+    uint32_t first_time = 0;
+    int last_seq = -1;
+    const size_t kFrameLength = kTelemetryBody + 3;
+    for (size_t i = 0; i + kFrameLength <= capture.size(); i++) {
+        const uint8_t* frame = &capture[i];
+        if (frame[0] != kFrameSync) {
+            continue;
+        }
+        const uint8_t* body = frame + 2;
+        if (frame[1] != kTelemetryBody || body[0] != 'T'
+                || FrameCrc(frame + 1, kTelemetryBody + 1) != frame[kFrameLength - 1]) {
+            // Out of step, or damaged: look for the next sync byte.
+            bad++;
+            continue;
+        }
+        i += kFrameLength - 1;
+
+        int seq = body[1];
+        uint32_t time = Read32(body + 3);
+        if (frames == 0) {
+            first_time = time;
+        } else {
+            missed += (seq - last_seq - 1) & 0xFF;
+        }
+        last_seq = seq;
+        frames++;
+        int command = body[25];
+        int flags = body[26];
+        printf("%.3f,%d,%d,%d,%d,%u,%d,%u,%.3f,%.3f,%s,%d,%d,%d,%d,%d\n",
+               (uint32_t)(time - first_time) / 1000.0, seq, 1 << body[2],
+               (int32_t)Read32(body + 7), (int32_t)Read32(body + 11),
+               Read16(body + 15), (int16_t)Read16(body + 17), Read16(body + 19),
+               Volts(Read16(body + 21)), Volts(Read16(body + 23)),
+               command < (int)(sizeof(kCommandNames) / sizeof(kCommandNames[0]))
+                   ? kCommandNames[command] : "?",
+               (flags & kTelemetryQueued) != 0, (flags & kTelemetryCollision) != 0,
+               (flags & kTelemetryIgnoring) != 0, (flags & kTelemetryLowPower) != 0,
+               (flags & kTelemetryTurnCheck) != 0);
+    }
+    fprintf(stderr, "telemetry_csv: %ld frames, %ld bad, %ld not sent\n",
+            frames, bad, missed);
+    return 0;
+}
\ No newline at end of file
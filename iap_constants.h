@@ -0,0 +1,48 @@
+/* iap_constants.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+#ifndef JDH_16_17_RASPI3_IAP_CONSTANTS_H_
+#define JDH_16_17_RASPI3_IAP_CONSTANTS_H_
+
+// Datasheet: <https://www.nxp.com/documents/user_manual/UM10360.pdf>
+// See page 626 for details on programming the flash from the firmware (In
+// Application Programming). The boot ROM does the work: put a command and its
+// parameters in one array, call IAP_LOCATION with it and another array, and
+// the status code and any results come back in the second. The flash can't be
+// read whilst it's being written or erased, so interrupts (whose vectors and
+// handlers are in flash) must be off. IAP also uses the top 32 bytes of RAM,
+// which the mbed's linker script leaves alone.
+
+// The entry point, in Thumb mode (datasheet section 32.8).
+#ifndef IAP_LOCATION
+#define IAP_LOCATION 0x1FFF1FF1
+#endif
+
+// Commands (datasheet table 589). Prepare takes the first and last sector;
+// copy takes the flash address (a multiple of 256), the RAM address (a
+// multiple of 4), the number of bytes (256, 512, 1024 or 4096) and CCLK in
+// kHz; erase takes the first and last sector and CCLK in kHz. Both copy and
+// erase need a prepare first.
+#define IAP_PREPARE_SECTORS 50
+#define IAP_COPY_RAM_TO_FLASH 51
+#define IAP_ERASE_SECTORS 52
+
+// Status codes (datasheet table 603).
+#define IAP_CMD_SUCCESS 0
+
+// The last sector of the LPC1768's 512 KB, which is 32 KB long (datasheet
+// table 580). The firmware is nowhere near big enough to reach it.
+#define IAP_LAST_SECTOR 29
+#ifndef IAP_LAST_SECTOR_ADDRESS
+#define IAP_LAST_SECTOR_ADDRESS 0x00078000
+#endif
+#define IAP_LAST_SECTOR_SIZE 0x8000
+// The smallest amount that can be copied into flash at once.
+#define IAP_MIN_COPY 256
+
+#endif  // JDH_16_17_RASPI3_IAP_CONSTANTS_H_
\ No newline at end of file
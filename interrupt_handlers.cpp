@@ -20,268 +20,959 @@
 
 #include "robot_specific.h"
 #include "pwm_constants.h"
+#include "timer_constants.h"
+#include "motion_profile.h"
+#include "motion_queue.h"
+#include "ring_buffer.h"
+#include "serial_tx.h"
+#include "frames.h"
+#include "step_stream.h"
+#include "collision_detector.h"
+#include "gyro.h"
+#include "isr_profile.h"
+#include "battery.h"
+#include "scheduler.h"
+#include "calibration.h"
 
-#define DECEL_FACTOR 4
-
-enum State {
-    kReadyForCommand,
-    // k*Received means "waiting for argument(s)", i.e. how far to move
-    kForwardReceived,
-    kBackwardReceived,
-    kLongDistanceReceived,
-    kLeftReceived,
-    kRightReceived
-};
-
+#if !STEP_COUNTER_TIMER
 volatile int steps_gone = 0;
-extern volatile int steps_left = 0;
-extern volatile int continue_steps = 0;
+volatile int steps_left = 0;
+#endif
+volatile MotionState motion;
+// The period of the step currently being taken, in PWM ticks.
 volatile int pwm_period = 0;
-volatile char dip_switch_state = 0;
-volatile State robot_state = kReadyForCommand;
-volatile bool period_update_needed = false;
-volatile bool force_low_power = false;
-// Track the currently executing command so that we can respond with its letter
-// when it ends.
-extern volatile CurrentCommand current_command = kNone;
-extern volatile CurrentCommand continue_command = kNone;
+// Bytes received from the Pi, waiting for ProcessCommands().
+RingBuffer<SerialByte, kSerialRxBufferSize> serial_rx;
+volatile int serial_rx_dropped = 0;
+// Requests for PwmHandler, each only ever counted up by whoever asks (main()
+// for the Notify*() functions, ScaleSpeed for replans), next to how many of
+// them PwmHandler has seen to. A count that has moved on is a request waiting;
+// since neither side writes the other's, there's no flag to clear and so no
+// race to lose one.
+static volatile uint32_t queue_requests = 0;
+static uint32_t queue_requests_seen = 0;
+static volatile uint32_t collision_requests = 0;
+static uint32_t collision_requests_seen = 0;
+static volatile uint32_t settled_requests = 0;
+static uint32_t settled_requests_seen = 0;
+#if STEP_PERIOD_DMA
+static volatile uint32_t replan_requests = 0;
+static uint32_t replan_requests_seen = 0;
+#endif
+// Closed-loop turns (see interrupt_handlers.h).
+volatile bool turn_trim_enabled = false;
+volatile int32_t last_turn_error = 0;
+volatile uint32_t last_turn_steps_per_degree = 0;
+// Where the current turn (or run of turns the same way) started, and where it
+// should end, relative to that, in kGyroUnitsPerDegree.
+static int32_t turn_start_yaw = 0;
+static int32_t turn_target = 0;
+// The steps taken in the turn before any trimming, and how many of them it
+// really took per degree (in Q16.16, like steps_per_degree), going by the gyro.
+static int turn_steps = 0;
+static uint32_t trim_steps_per_degree = 0;
+// How many times the current turn has been trimmed. Whilst trimming, the robot
+// doesn't carry on into queued moves.
+static int turn_trims = 0;
+// See TakePausedMove(). Only main() writes pauses_taken.
+static volatile PausedMove paused_move;
+static uint32_t pauses_taken = 0;
+
+// Marks the motion state as changing for as long as it's in scope (see
+// MotionState). Put one at the top of each step interrupt handler.
+class MotionUpdate {
+  public:
+    MotionUpdate() {
+        motion.sequence++;
+        __DMB();
+    }
+    ~MotionUpdate() {
+        __DMB();
+        motion.sequence++;
+    }
+};
 
 // DigitalOuts are inherently "volatile", so they don't need to be explicitly
 // declared as such. If they are, things break.
 DigitalOut led_pwm_interrupt(p11);
 DigitalOut led_accelerate(p12);
 DigitalOut led_decelerate(p13);
-DigitalOut led_left(p14);
-DigitalOut led_right(p10);
 DigitalOut low_power(LED1);
 DigitalOut updating_speed(LED4);
 
 
+// The move being carried out, including which way the wheels are turning.
+MotionSegment current_segment;
+// How many steps of queued moves the robot can carry straight on into after
+// the current one (see motion_queue.h).
+volatile int lookahead_steps = 0;
+
+// Arcs. With SEPARATE_STEP_CLOCKS, each wheel has its own step pulses, but
+// they still share PWM1's period. During an arc, the outer wheel steps every
+// period, following the profile as usual, and the inner wheel's pulse is left
+// out of the periods it should skip. These are spread out evenly, in the same
+// way as Bresenham's line algorithm, so it takes exactly its steps in the same
+// number of periods and both wheels finish together. PwmHandler plans every
+// period itself and counts them, whatever the step counting: TIMER2 only sees
+// the left wheel's pulses, and the DMA can't leave any out.
+#if SEPARATE_STEP_CLOCKS
+static bool arcing = false;
+// Periods with steps in them still to be planned, or -1 once the quiet period
+// after the last one has been.
+static int arc_periods_left = 0;
+static int arc_error = 0;
+#else
+static const bool arcing = false;
+#endif
+
+// The match registers that set the widths of the step pulses.
+#if SEPARATE_STEP_CLOCKS
+const uint32_t kPulseLatches = PWM_LER_MR3 | PWM_LER_MR4;
+#else
+const uint32_t kPulseLatches = PWM_LER_MR4;
+#endif
+
+// Sets how long each wheel's next step pulse is, in PWM ticks (0 for no step).
+// Without SEPARATE_STEP_CLOCKS, p23 drives both wheels and |right| is ignored.
+// Takes effect when the LER says so.
+static void SetPulseWidths(uint32_t left, uint32_t right) {
+    LPC_PWM1->MR4 = left;
+#if SEPARATE_STEP_CLOCKS
+    LPC_PWM1->MR3 = right;
+#else
+    (void)right;
+#endif
+}
+
+// Step counting. Without STEP_COUNTER_TIMER, every step raises a PWM match 4
+// interrupt, and PwmHandler counts steps_left down. With it, TIMER2 counts the
+// pulses on p30 (wired to p23) instead: its MR0 is set to the count at which
+// the move ends, and TIMER2 interrupts only then. TIMER2's counter is never
+// reset, so everything is relative to it. PwmHandler still runs every step
+// whilst the robot is speeding up or slowing down, but switches its own
+// interrupt off at top speed, and TIMER2's MR1 switches it back on when it's
+// time to slow down (see BrakingPoint()). With STEP_PERIOD_DMA as well, the
+// GPDMA controller sets the period of every step (see step_stream.h), and the
+// end of a move is a DMA interrupt instead.
+
+#if STEP_PERIOD_DMA
+// Where the current move starts and ends, in steps since the robot was last at
+// rest.
+static int segment_start = 0;
+static int segment_end = 0;
+
+static int CountedStepsLeft() {
+    return segment_end - StreamPosition();
+}
+
+static int CountedStepsGone() {
+    return StreamPosition() - segment_start;
+}
+
+// Plans the steps from here to the end of the current move, and on through the
+// queued moves it can run straight into.
+static void PlanSteps() {
+    int ends[kMaxStreamEnds];
+    int count = 1;
+    ends[0] = segment_end;
+    if (!motion.collided && turn_trims == 0) {
+        int lengths[kMotionQueueSize];
+        int queued = LengthsWithoutReversal(current_segment, lengths, kMotionQueueSize);
+        for (int i = 0; i < queued && count < kMaxStreamEnds; i++, count++) {
+            ends[count] = ends[count - 1] + lengths[i];
+        }
+    }
+    PlanStream(ends, count);
+}
+
+static void StartCounting(int steps) {
+    segment_start = 0;
+    segment_end = steps > 0 ? steps : 1;
+    StartStream();
+    PlanSteps();
+}
+
+// The plan already runs on into the next move, so there's nothing to redo.
+static void ExtendCount(int steps) {
+    segment_start = segment_end;
+    segment_end += steps;
+}
+
+static int CutCountShort(int steps) {
+    int cut = 0;
+    if (StepsLeft() > steps) {
+        int end = StreamPosition() + steps;
+        cut = segment_end - end;
+        segment_end = end;
+    }
+    PlanSteps();
+    return cut;
+}
+#elif STEP_COUNTER_TIMER
+// The count at which the current move started.
+static uint32_t count_start = 0;
+
+static int CountedStepsLeft() {
+    return (int)(LPC_TIM2->MR0 - LPC_TIM2->TC);
+}
+
+static int CountedStepsGone() {
+    return (int)(LPC_TIM2->TC - count_start);
+}
+
+// Starts counting a move of |steps| from rest.
+static void StartCounting(int steps) {
+    count_start = LPC_TIM2->TC;
+    // A move of no steps still takes one, as it does with match 4 counting
+    // (and TIMER2 can't match on a count it's already at).
+    LPC_TIM2->MR0 = LPC_TIM2->TC + (steps > 0 ? steps : 1);
+}
+
+// Adds |steps| to the move being counted, which starts where the last one
+// ended.
+static void ExtendCount(int steps) {
+    count_start = LPC_TIM2->MR0;
+    LPC_TIM2->MR0 += steps;
+}
+
+// Makes the current move end |steps| from now, if it would otherwise go on for
+// longer than that. Returns how many steps it took off the end.
+static int CutCountShort(int steps) {
+    int cut = 0;
+    if (StepsLeft() > steps) {
+        uint32_t end = LPC_TIM2->TC + steps;
+        cut = (int)(LPC_TIM2->MR0 - end);
+        LPC_TIM2->MR0 = end;
+    }
+    LPC_PWM1->MCR |= PWM_MR0_INTERRUPT;  // slow down now, not at the old point
+    return cut;
+}
+
+// The count at which PwmHandler has to start planning steps again if the robot
+// is at top speed: from then on, the number of steps to the end is less than
+// the number it takes to slow down. Doesn't depend on where the robot is now.
+static unsigned int BrakingPoint() {
+    return LPC_TIM2->MR0 + lookahead_steps - 1 - BrakingSteps();
+}
+#else
+// Whether the PWM period that StartWheels() has just started has no step in it
+// (see there), so that PwmHandler doesn't count its match 4 interrupt.
+static bool empty_period = false;
+
+static int CountedStepsLeft() {
+    return steps_left;
+}
+
+static int CountedStepsGone() {
+    return steps_gone;
+}
+
+static void StartCounting(int steps) {
+    steps_left = steps;
+    steps_gone = 0;
+}
+
+static void ExtendCount(int steps) {
+    steps_left += steps;
+    steps_gone = 0;
+}
+
+static int CutCountShort(int steps) {
+    int cut = 0;
+    if (steps_left > steps) {
+        cut = steps_left - steps;
+        steps_left = steps;
+    }
+    return cut;
+}
+#endif
+
+int StepsLeft() {
+#if SEPARATE_STEP_CLOCKS
+    if (arcing) {
+        return arc_periods_left + 1;  // including the one being taken
+    }
+#endif
+    return CountedStepsLeft();
+}
+
+int StepsGone() {
+#if SEPARATE_STEP_CLOCKS
+    if (arcing) {
+        return current_segment.steps - 1 - arc_periods_left;
+    }
+#endif
+    return CountedStepsGone();
+}
+
+// Adds the steps each wheel has taken in |segment|, when the outer one has
+// taken |gone|, to |left| and |right|.
+static void AddSegmentSteps(const volatile MotionSegment& segment, int gone,
+                            int32_t* left, int32_t* right) {
+    int steps = segment.steps;
+    int inner = gone;
+    if (segment.command == kArcLeft || segment.command == kArcRight) {
+        if (steps > 0) {
+            inner = (int)((int64_t)gone * segment.inner_steps / steps);
+        }
+    }
+    // Going round to the left, the left wheel is on the inside.
+    int left_gone = segment.command == kArcLeft ? inner : gone;
+    int right_gone = segment.command == kArcRight ? inner : gone;
+    *left += segment.left_forward ? left_gone : -left_gone;
+    *right += segment.right_forward ? right_gone : -right_gone;
+}
+
+// Call once the current move has taken all its steps, before anything else
+// replaces current_segment.
+static void CountSegmentSteps() {
+    int32_t left = motion.left_wheel_steps;
+    int32_t right = motion.right_wheel_steps;
+    AddSegmentSteps(current_segment, current_segment.steps, &left, &right);
+    motion.left_wheel_steps = left;
+    motion.right_wheel_steps = right;
+}
+
+void ReadMotion(MotionSnapshot* snapshot) {
+    const volatile MotionSegment& segment = current_segment;
+    uint32_t sequence;
+    do {
+        sequence = motion.sequence;
+        __DMB();
+        snapshot->command = motion.command;
+        snapshot->collided = motion.collided;
+        snapshot->checking_turn = motion.checking_turn;
+        snapshot->left_wheel_steps = motion.left_wheel_steps;
+        snapshot->right_wheel_steps = motion.right_wheel_steps;
+        snapshot->steps_gone = 0;
+        snapshot->steps_left = 0;
+        snapshot->low_power = false;
+        if (snapshot->command != kNone) {
+            // The step counters run on in hardware, so these can be a step
+            // newer than the rest; that's still within the same move. The DMA
+            // can have gone on into the next move before StepStreamHandler
+            // has caught up, but those steps are that move's.
+            int gone = StepsGone();
+            int steps = segment.steps;
+            if (gone > steps) {
+                gone = steps;
+            }
+            snapshot->steps_gone = gone;
+            snapshot->steps_left = steps - gone;
+            snapshot->low_power = segment.low_power;
+            AddSegmentSteps(segment, gone, &snapshot->left_wheel_steps,
+                            &snapshot->right_wheel_steps);
+        }
+        __DMB();
+        // Odd means a step interrupt was part of the way through changing
+        // things when this started; a different count means one got in.
+    } while ((sequence & 1) || motion.sequence != sequence);
+}
+
+// Sends the character that says |command| has finished, framed with |tag| if
+// it came in a frame (see frames.h).
+static void ReportCompletion(CurrentCommand command, int tag) {
+    switch (command) {
+        case kMoveForward:
+            if (!motion.collided) {
+                SendReply('f', tag);
+            } else {
+                SendReply('e', tag);
+            }
+            break;
+        case kMoveBackward:
+            if (!motion.collided) {
+                SendReply('b', tag);
+            } else {
+                SendReply('e', tag);
+            }
+            break;
+        case kMoveLongDistance:
+            if (!motion.collided) {
+                SendReply('F', tag);
+            } else {
+                SendReply('e', tag);
+            }
+            break;
+        case kTurnLeft:
+            SendReply('l', tag);
+            break;
+        case kTurnRight:
+            SendReply('r', tag);
+            break;
+        case kArcLeft:
+            SendReply('L', tag);
+            break;
+        case kArcRight:
+            SendReply('R', tag);
+            break;
+        default:
+            //SerialSend('d');
+            break;
+    }
+    PostEvent(kEventMoveDone);
+}
+
+static bool IsTurn(CurrentCommand command) {
+    return command == kTurnLeft || command == kTurnRight;
+}
+
+// How far the turn in |segment| should take the robot, in kGyroUnitsPerDegree,
+// anticlockwise positive.
+static int32_t TurnAngle(const MotionSegment& segment) {
+    int32_t angle = (int32_t)(((int64_t)segment.steps * kGyroUnitsPerDegree << 16)
+                              / steps_per_degree);
+    return segment.command == kTurnLeft ? angle : -angle;
+}
+
+// The number of steps in the queued moves that the robot can carry straight on
+// into from current_segment.
+static int Lookahead() {
+    return turn_trims == 0 ? StepsWithoutReversal(current_segment) : 0;
+}
+
+// The supply level the motion profile should allow for (see battery.h): what
+// it is, unless the current move is low power ('A').
+static uint16_t SupplyLevel() {
+    uint16_t level = BatteryLevel();
+    const uint16_t low_power_level = (uint16_t)(kLowPowerLevel * 65535);
+    return current_segment.low_power && level > low_power_level ? low_power_level : level;
+}
+
+#if SEPARATE_STEP_CLOCKS
+// Sets up the step pulses for the next period of an arc, which has |period|
+// ticks: the outer wheel always steps, the inner one only sometimes.
+static void SetArcPulses(int period) {
+    uint32_t outer = period / 2;
+    uint32_t inner = 0;
+    arc_error += current_segment.inner_steps;
+    if (arc_error >= current_segment.steps) {
+        arc_error -= current_segment.steps;
+        inner = outer;
+    }
+    if (current_segment.command == kArcLeft) {
+        SetPulseWidths(inner, outer);
+    } else {
+        SetPulseWidths(outer, inner);
+    }
+}
+
+// Starts current_segment, an arc, with the PWM set to the first period.
+static void StartArc() {
+    arc_error = current_segment.steps / 2;
+    arc_periods_left = current_segment.steps - 1;  // the first is planned here
+    lookahead_steps = 0;
+    SetArcPulses(pwm_period);
+    LPC_PWM1->LER |= kPulseLatches;
+    LPC_PWM1->MCR |= PWM_MR0_INTERRUPT;
+}
+#endif
+
+// Starts the wheels turning for current_segment, from rest.
+static void StartWheels() {
+    if (current_segment.left_forward) {
+        LeftWheelForward();
+    } else {
+        LeftWheelBack();
+    }
+    if (current_segment.right_forward) {
+        RightWheelForward();
+    } else {
+        RightWheelBack();
+    }
+    pwm_period = StartProfile(SupplyLevel());
+    low_power = ramp_limit < ramp_steps || ramp_rate < 256;
+#if SEPARATE_STEP_CLOCKS
+    arcing = IsArc(current_segment);
+    if (arcing) {
+#if STEP_PERIOD_DMA
+        // The stream's latch channel would otherwise go on setting the LER
+        // for MR0 alone (MoveOn() doesn't stop it between moves).
+        StopStream();
+#endif
+        // Only the periods StartArc() and PlanArcPeriod() plan should have
+        // steps in them, so make sure whatever comes before them doesn't.
+        SetPulseWidths(0, 0);
+        pwm.period_us(pwm_period / PWM_TICKS_PER_US);
+        StartArc();
+        return;
+    }
+#endif
+    StartCounting(current_segment.steps);
+    lookahead_steps = Lookahead();
+#if !STEP_COUNTER_TIMER
+    // Restarting the PWM starts a period with the pulse width it already had,
+    // since the new one is only latched at the end of it. After a move that's
+    // 0, and match 4 interrupts anyway, but there's no step to count. Nor is
+    // there one in an interrupt still pending from before the restart.
+    empty_period = LPC_PWM1->MR4 == 0;
+    LPC_PWM1->IR = PWM_IR_MR4;
+#endif
+#if STEP_COUNTER_TIMER && !STEP_PERIOD_DMA
+    LPC_PWM1->MCR |= PWM_MR0_INTERRUPT;
+#elif STEP_PERIOD_DMA && SEPARATE_STEP_CLOCKS
+    LPC_PWM1->MCR &= ~(PWM_MR0_INTERRUPT);  // in case an arc left it on
+#endif
+    pwm.period_us(pwm_period / PWM_TICKS_PER_US);
+#if STEP_PERIOD_DMA
+    SetPulseWidths(StreamPulseTicks(), StreamPulseTicks());
+#else
+    SetPulseWidths(pwm_period / 2, pwm_period / 2);
+#endif
+    LPC_PWM1->LER |= kPulseLatches;
+}
+
+// Stops the step clock.
+static void StopWheels() {
+    // No more pulses from the next period on.
+    SetPulseWidths(0, 0);
+    LPC_PWM1->LER |= kPulseLatches;
+#if SEPARATE_STEP_CLOCKS
+    arcing = false;
+#endif
+#if STEP_PERIOD_DMA
+    StopStream();
+#if SEPARATE_STEP_CLOCKS
+    LPC_PWM1->MCR &= ~(PWM_MR0_INTERRUPT);
+#endif
+#elif STEP_COUNTER_TIMER
+    // Nothing to plan until the next move.
+    LPC_PWM1->MCR &= ~(PWM_MR0_INTERRUPT);
+#endif
+}
+
+// Starts the move in current_segment, from rest.
+static void StartMoving() {
+    motion.collided = false;
+    motion.paused = false;  // the Pi has moved on without it
+    PostEvent(kEventMoveStarted);  // main() starts the collision detector afresh
+    motion.command = current_segment.command;
+    turn_trims = 0;
+    if (IsTurn(motion.command)) {
+        turn_start_yaw = yaw;
+        turn_target = TurnAngle(current_segment);
+        turn_steps = current_segment.steps;
+    }
+    StartWheels();
+}
+
+// Moves on to the next queued move, carrying straight on into it if the wheels
+// are |running| and neither has to reverse; otherwise stops.
+static void MoveOn(bool running) {
+    CountSegmentSteps();
+    MotionSegment next;
+    if (motion.collided) {
+        // Whatever was queued was planned without knowing we'd hit something.
+        while (PopSegment(&next)) {
+            SendReply('e', next.tag);
+        }
+    } else {
+        while (PopSegment(&next)) {
+            if (!running || !ContinuesWithoutReversal(current_segment, next)) {
+                // The profile has already brought us down to the starting
+                // speed, so the direction can change now.
+                SetPulseWidths(0, 0);
+                LPC_PWM1->LER |= kPulseLatches;
+                current_segment = next;
+                StartMoving();
+                return;
+            }
+            current_segment = next;
+            motion.command = next.command;
+            if (IsTurn(motion.command)) {
+                turn_target += TurnAngle(next);  // one turn, checked at the end
+                turn_steps += next.steps;
+            }
+            ExtendCount(next.steps);
+            lookahead_steps = Lookahead();
+            if (StepsLeft() > 0) {
+                return;  // the step clock just keeps going
+            }
+            ReportCompletion(motion.command, current_segment.tag);  // a zero-length move
+        }
+    }
+    StopWheels();
+    //SerialSend('d');  // say we're done driving
+    lookahead_steps = 0;
+    motion.command = kNone;
+}
+
+// Called when the current move has taken all its steps.
+static void FinishMove() {
+    // A paused turn is finished off by carrying on with it, not by trimming.
+    if (turn_trim_enabled && IsTurn(motion.command) && lookahead_steps == 0
+            && !motion.collided) {
+        // Stop, and wait for main() to say that the gyro has caught up before
+        // deciding whether the turn went far enough (see FinishTurn()).
+        StopWheels();
+        motion.checking_turn = true;
+        motion.turn_checks++;
+        return;
+    }
+    ReportCompletion(motion.command, current_segment.tag);
+    MoveOn(true);
+}
+
+// Turns the robot by |error| (in kGyroUnitsPerDegree, anticlockwise positive)
+// from rest, as part of the current turn.
+static void StartTrim(int32_t error) {
+    if (turn_trims == 0) {
+        // If the wheels slipped on the way round, they'll slip by about as
+        // much whilst trimming, so go by how far the turn actually got. Don't
+        // believe anything too far from steps_per_degree, though.
+        int64_t measured = last_turn_steps_per_degree;
+        if (measured == 0) {
+            measured = steps_per_degree;
+        }
+        if (measured > 2 * (int64_t)steps_per_degree) {
+            measured = 2 * (int64_t)steps_per_degree;
+        } else if (measured < steps_per_degree / 2) {
+            measured = steps_per_degree / 2;
+        }
+        trim_steps_per_degree = (uint32_t)measured;
+    }
+    int32_t size = error > 0 ? error : -error;
+    int steps = (int)(((int64_t)size * trim_steps_per_degree / kGyroUnitsPerDegree + 0x8000) >> 16);
+    turn_trims++;
+    CountSegmentSteps();
+    int tag = current_segment.tag;  // it's still the same command
+    current_segment = MakeSegment(error > 0 ? kTurnLeft : kTurnRight, steps);
+    current_segment.tag = tag;
+    StartWheels();
+}
+
+// Called once the robot has stopped at the end of a turn and the gyro has
+// caught up. Trims the turn if it's too far out, or else replies and moves on.
+static void FinishTurn() {
+    if (turn_trims == 0) {
+        int32_t turned = YawSince(turn_start_yaw);
+        turned = turned > 0 ? turned : -turned;
+        int64_t measured = 0;
+        if (turned > 0) {
+            measured = ((int64_t)turn_steps * kGyroUnitsPerDegree << 16) / turned;
+        }
+        last_turn_steps_per_degree = measured > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)measured;
+    }
+    int32_t error = turn_target - YawSince(turn_start_yaw);
+    int32_t tolerance = (int32_t)(kTurnTolerance * kGyroUnitsPerDegree);
+    if ((error > tolerance || error < -tolerance) && turn_trims < kMaxTurnTrims) {
+        StartTrim(error);
+        return;
+    }
+    last_turn_error = error;
+    ReportCompletion(motion.command, current_segment.tag);
+    MoveOn(false);
+}
+
+// Brings the current move to a stop after a collision, and keeps what was left
+// of it in paused_move. The robot slows down as it would at the end of the
+// move if it can do so within kMaxPauseSteps, and otherwise raises ramp_rate
+// so that NextStepPeriod() brings it down in that distance instead of jumping
+// straight to a standstill. The steps cut off the end are exactly the ones
+// that are kept, so carrying on gets the robot to where the move would have.
+static void PauseMove() {
+    // Before cutting the move short, so that a new plan leaves out the queue.
+    motion.collided = true;
+    lookahead_steps = 0;
+    if (arcing) {
+        return;  // arcs aren't cut short; they finish as planned
+    }
+#if STEP_PERIOD_DMA
+    profile_step = StreamProfileStep();
+#endif
+    // The steps it takes to get down to the bottom of the profile from here.
+    int slowing = (profile_step * 256 + ramp_rate - 1) / ramp_rate;
+    int most = kMaxPauseSteps - 2;
+    if (most < (profile_step + 15) / 16) {
+        most = (profile_step + 15) / 16;  // see kMaxPauseSteps
+    }
+    if (slowing > most) {
+        slowing = most;
+#if !STEP_PERIOD_DMA
+        ramp_rate = (profile_step * 256 + slowing - 1) / slowing;
+#endif
+        // (The step stream always slows down at the full rate, so it still
+        // has to jump down some of the way.)
+    }
+    // The step being taken now and the one already planned after it come on
+    // top of that.
+    int cut = CutCountShort(slowing + 2);
+    if (cut > 0) {
+        // The move is now the steps it will have taken by the time it stops.
+        current_segment.steps -= cut;
+        current_segment.inner_steps -= cut;
+        paused_move.command = motion.command;
+        paused_move.steps = cut;
+        paused_move.low_power = current_segment.low_power;
+        motion.paused = true;
+        motion.pauses++;
+    }
+}
+
+bool TakePausedMove(PausedMove* move) {
+    uint32_t sequence;
+    bool paused;
+    uint32_t pauses;
+    do {
+        sequence = motion.sequence;
+        __DMB();
+        paused = motion.paused;
+        pauses = motion.pauses;
+        move->command = paused_move.command;
+        move->steps = paused_move.steps;
+        move->low_power = paused_move.low_power;
+        __DMB();
+    } while ((sequence & 1) || motion.sequence != sequence);
+    // PwmHandler never clears motion.paused for us, so count what's been
+    // taken instead.
+    if (!paused || pauses == pauses_taken) {
+        return false;
+    }
+    pauses_taken = pauses;
+    return true;
+}
+
+#if SEPARATE_STEP_CLOCKS
+// Called at the start of every period of an arc, to plan the one after it.
+static void PlanArcPeriod() {
+    if (arc_periods_left > 0) {
+        arc_periods_left--;
+        pwm_period = NextStepPeriod(arc_periods_left);
+        LPC_PWM1->MR0 = pwm_period;
+        SetArcPulses(pwm_period);
+        LPC_PWM1->LER = PWM_LER_MR0 | kPulseLatches;
+    } else if (arc_periods_left == 0) {
+        // The last step is being taken now; make sure the period after it
+        // doesn't have another.
+        arc_periods_left = -1;
+        SetPulseWidths(0, 0);
+        LPC_PWM1->LER = kPulseLatches;
+    } else {
+        FinishMove();
+    }
+}
+#endif
+
 // This keeps track of how far the robot has gone, and stops it when it's gone
 // far enough. It also sends a character over serial to say that it's finished.
 void PwmHandler() {
+    PROFILE_ISR(kProfilePwmHandler);
+    MotionUpdate update;
+    // Something new in the motion queue: start it if we're stopped, otherwise
+    // take it into account when deciding when to slow down.
+    if (queue_requests != queue_requests_seen) {
+        queue_requests_seen = queue_requests;
+        if (motion.command == kNone) {
+            if (PopSegment(&current_segment)) {
+                StartMoving();
+            }
+        } else if (!motion.checking_turn && !arcing) {
+            lookahead_steps = Lookahead();
+#if STEP_PERIOD_DMA
+            PlanSteps();
+#elif STEP_COUNTER_TIMER
+            LPC_TIM2->MR1 = BrakingPoint();
+#endif
+        }
+    }
+    // main() has seen the end of a turn come through the gyro.
+    if (settled_requests != settled_requests_seen) {
+        settled_requests_seen = settled_requests;
+        if (motion.checking_turn) {
+            motion.checking_turn = false;
+            FinishTurn();
+        }
+    }
+#if STEP_PERIOD_DMA
+    if (replan_requests != replan_requests_seen) {
+        replan_requests_seen = replan_requests;
+        if (motion.command != kNone && !motion.checking_turn && !arcing) {
+            PlanSteps();
+        }
+    }
+#endif
+#if !STEP_COUNTER_TIMER
     // Check whether a match 4 interrupt is pending (we're only interested if it is).
     if (LPC_PWM1->IR & PWM_IR_MR4) {
         led_pwm_interrupt = !led_pwm_interrupt;
-        steps_gone++;
-        steps_left--;
-        if (steps_left <= 0) {            
-            pwm.pulsewidth_ms(0);  // disable PWM by setting duty cycle to 0
-            //usb_serial.putc('d');  // say we're done driving
-            switch (current_command) {
-                case kMoveForward:
-                    if (!GyroTurnDetected) {
-                        usb_serial.putc('f');
-                    } else {
-                        usb_serial.putc('e');
-                    }
-                    break;
-                case kMoveBackward:
-                    if (!GyroTurnDetected) {
-                        usb_serial.putc('b');
-                    } else {
-                        usb_serial.putc('e');
-                    }
-                    break;
-                case kMoveLongDistance:
-                    if (!GyroTurnDetected) {
-                        usb_serial.putc('F');
-                    } else {
-                        usb_serial.putc('e');
-                    }
-                    break;
-                case kTurnLeft:
-                    usb_serial.putc('l');
-                    break;
-                case kTurnRight:
-                    usb_serial.putc('r');
-                    break;
-                default:
-                    //usb_serial.putc('d');
-                    break;
+        if (empty_period) {
+            empty_period = false;
+        } else {
+            steps_gone++;
+            steps_left--;
+            if (steps_left <= 0 && motion.command != kNone && !motion.checking_turn
+                    && !arcing) {
+                FinishMove();
             }
-            current_command = kNone;
         }
         LPC_PWM1->IR = PWM_IR_MR4;  // clear the interrupt flag (yes, by writing a 1 to it)
     }
+#endif
+    // A collision: stop within kMaxPauseSteps, remembering what was left of
+    // the move so that the Pi can carry on with it ('c'). This comes after
+    // counting any step that's just been taken, so that none go missing.
+    if (collision_requests != collision_requests_seen) {
+        collision_requests_seen = collision_requests;
+        if (!motion.collided && motion.command != kNone) {
+            PauseMove();
+        }
+    }
+#if SEPARATE_STEP_CLOCKS
+    if ((LPC_PWM1->IR & PWM_IR_MR0) && arcing) {
+        PlanArcPeriod();
+        LPC_PWM1->IR = PWM_IR_MR0;
+        return;
+    }
+#endif
     if (LPC_PWM1->IR & PWM_IR_MR0) {
-        // Update speed calculated by ScaleSpeed
-        if (period_update_needed) {
-            pwm.period_us(pwm_period);
-            pwm = 0.5;
-            period_update_needed = false;
+        // A new period (and so a new step) has just started. Set up the length
+        // of the one after it; the LER makes the new values take effect when
+        // this period ends, so there's no glitch on the output. Don't plan
+        // into the queue after a collision, since it's about to be thrown away.
+        int to_end = StepsLeft() - 2;
+        if (!motion.collided) {
+            to_end += lookahead_steps;
+        }
+        if (to_end >= 0) {
+            pwm_period = NextStepPeriod(to_end);
+            LPC_PWM1->MR0 = pwm_period;
+            SetPulseWidths(pwm_period / 2, pwm_period / 2);
+            LPC_PWM1->LER = PWM_LER_MR0 | kPulseLatches;
+        }
+#if STEP_COUNTER_TIMER && !STEP_PERIOD_DMA
+        if (profile_step == ramp_limit - 1 && !motion.collided
+                && (int)(BrakingPoint() - LPC_TIM2->TC) > 1) {
+            // At top speed with a way to go: the period won't change until
+            // it's time to slow down, so don't interrupt until then.
+            LPC_TIM2->MR1 = BrakingPoint();
+            LPC_PWM1->MCR &= ~(PWM_MR0_INTERRUPT);
         }
+#endif
         LPC_PWM1->IR = PWM_IR_MR0;
     }
     // Clear all interrupts, just in case one we aren't interested in fired.
     //LPC_PWM1->IR = PWM_IR_ALL;
 }
 
-// Alters the current speed of the robot to perform acceleration and
-// deceleration. The more often this is called, the faster the robot will change
-// speed. In order to disable acceleration, comment out the ticker.attach(...)
-// line in main.cpp.
+// Keeps an eye on the motor supply whilst the robot is speeding up, and stops
+// it speeding up any further if the voltage is low, so that the motors don't
+// stall. The speed itself is set step by step in PwmHandler, from the profile
+// in motion_profile.cpp. Also shows what the robot is doing on the LEDs.
 void ScaleSpeed() {
-    if (steps_left == 0) {
+    PROFILE_ISR(kProfileScaleSpeed);
+    if (motion.command == kNone) {
         led_accelerate = 0;
         led_decelerate = 0;
         return;  // No point scaling speed when not moving.
     }
+#if STEP_PERIOD_DMA
+    // The DMA doesn't keep profile_step up to date (but PwmHandler does for
+    // arcs).
+    if (!arcing) {
+        profile_step = StreamProfileStep();
+    }
+#endif
 
-    period_update_needed = true; // probably
-    if (steps_gone < kAccelDecelSteps) {
-        // not gone far, probably accelerate
-        if (steps_left < (steps_gone / DECEL_FACTOR)) {
-            // more than halfway there (but still close to start), decelerate
-            if (pwm_period < kInitialPwmPeriod) {
-                led_accelerate = 0;
-                led_decelerate = 1;
-                pwm_period += (kPwmPeriodIncrement * DECEL_FACTOR);
-            }
-        } else {
-            if (battery_voltage.read() < kLowPowerThreshold || force_low_power) {
-                // Low power
-                if (steps_gone < kAccelLowPowerSteps) {
-                    // accelerate anyway
-                    led_accelerate = 1;
-                    led_decelerate = 0;
-                    pwm_period -= kPwmPeriodIncrement;
-                }
-            } else {
-                // less than halfway there (and not gone far), accelerate
-                led_accelerate = 1;
-                led_decelerate = 0;
-                pwm_period -= kPwmPeriodIncrement;
-            }
-        }
-    } else if (steps_left < (kAccelDecelSteps / DECEL_FACTOR)) {
-        if (pwm_period < kInitialPwmPeriod) {
-            // almost done moving, decelerate
-            led_accelerate = 0;
-            led_decelerate = 1;
-            pwm_period += (kPwmPeriodIncrement * DECEL_FACTOR);
+    int to_end = StepsLeft() + lookahead_steps;
+    int braking = to_end < (1 << 19) ? to_end * ramp_rate >> 8 : to_end;
+    if (profile_step < ramp_limit - 1 && profile_step < braking) {
+        // Still speeding up. If the supply has sagged, don't go any faster
+        // than it can now keep up with -- but don't slow down either, since
+        // a sudden drop in speed could lose steps.
+        int limit = ramp_limit;
+        int supply_limit = SupplyRampLimit(SupplyLevel());
+        LimitAcceleration(supply_limit > profile_step ? supply_limit : profile_step + 1);
+        if (ramp_limit != limit) {
+            low_power = 1;
+#if STEP_PERIOD_DMA
+            replan_requests++;
+            NVIC_SetPendingIRQ(PWM1_IRQn);
+#endif
         }
+        led_accelerate = 1;
+        led_decelerate = 0;
+    } else if (profile_step >= braking - 1) {
+        // almost done moving, slowing down
+        led_accelerate = 0;
+        led_decelerate = 1;
     } else {
-        // In the middle of movement, don't change speed.
+        // In the middle of movement, not changing speed.
         led_accelerate = 1;
         led_decelerate = 1;
-        period_update_needed = false;
     }
-    //pwm.period_us(pwm_period);
-    // Make sure there is both a rising and falling edge at some point in the
-    // cycle.
-    //pwm = 0.5;
 }
 
-// This is called every time the mbed receives a character over serial. It sets
-// the wheels to turn in the right direction, and makes the robot start moving.
-void SerialHandler() {
-    if (!usb_serial.readable()) {
-        // There's not actually anything available to read(!), abort.
-        return;
+#if STEP_PERIOD_DMA
+// This is called when the GPDMA controller has finished a link that ends a
+// move (or that ends as much of the plan as would fit; see step_stream.cpp).
+void StepStreamHandler() {
+    PROFILE_ISR(kProfileStepStreamHandler);
+    MotionUpdate update;
+    if (LPC_GPDMA->DMACIntTCStat & kStreamChannelMask) {
+        LPC_GPDMA->DMACIntTCClear = kStreamChannelMask;
+        if (StreamInterrupt() && motion.command != kNone) {
+            FinishMove();
+        }
     }
-    char character = usb_serial.getc();
-    switch (robot_state) {
-        case kReadyForCommand:
-            GyroTurnDetected = false;
-            ignore_for = 1024;
-            switch (character) {
-                case 'f':  // move forwards
-                    force_low_power = false;
-                    robot_state = kForwardReceived;
-                    break;
-                case 'b':  // move backwards
-                    robot_state = kBackwardReceived;
-                    break;
-                case 'F':  // move forwards lots
-                    robot_state = kLongDistanceReceived;
-                    break;
-                case 'l':  // turn left
-                    led_left = 1;
-                    led_right = 0;
-                    robot_state = kLeftReceived;
-                    break;
-                case 'r':  // turn right
-                    led_right = 1;
-                    led_left = 0;
-                    robot_state = kRightReceived;
-                    break;
-                case 's':  // get DIP switch state
-                    dip_switch_state = (char)dip_switch.read();
-                    usb_serial.putc(dip_switch_state);
-                    break;
-                case 'c': // continue after a collision with whatever was being done
-                    // The robot might judder slightly if called if a crash hasn't occured first
-                    // Either that or move forwards uncontrollably.
-                    current_command = continue_command;
-                    // Stepper motors already configured correctly
-                    steps_left = continue_steps;
-                    steps_gone = 0;
-                    pwm_period = kInitialPwmPeriod;
-                    pwm.period_us(pwm_period);
-                    pwm = 0.5;
-                    robot_state = kReadyForCommand;
-                    break;
-                case 'A':
-                    force_low_power = true;
-                    robot_state = kForwardReceived;
-                    break;
-            }
-            break;
-        case kForwardReceived:
-            current_command = kMoveForward;
-            steps_left = character * kStepsPerCentimetre;
-            steps_gone = 0;
-            LeftWheelForward();
-            RightWheelForward();
-            pwm_period = kInitialPwmPeriod;
-            pwm.period_us(pwm_period);
-            pwm = 0.5;
-            robot_state = kReadyForCommand;
-            break;
-        case kBackwardReceived:
-            current_command = kMoveBackward;
-            steps_left = character * kStepsPerCentimetre;
-            steps_gone = 0;
-            LeftWheelBack();
-            RightWheelBack();
-            pwm_period = kInitialPwmPeriod;
-            pwm.period_us(pwm_period);
-            pwm = 0.5;
-            robot_state = kReadyForCommand;
-            break;
-        case kLongDistanceReceived:
-            current_command = kMoveLongDistance;
-            steps_left = character * 10 * kStepsPerCentimetre;
-            steps_gone = 0;
-            LeftWheelForward();
-            RightWheelForward();
-            pwm_period = kInitialPwmPeriod;
-            pwm.period_us(pwm_period);
-            pwm = 0.5;
-            robot_state = kReadyForCommand;
-            break;
-        case kLeftReceived:
-            current_command = kTurnLeft;
-            steps_left = character * kStepsPerDegree;
-            steps_gone = 0;
-            LeftWheelBack();
-            RightWheelForward();
-            pwm_period = kInitialPwmPeriod;
-            pwm.period_us(pwm_period);
-            pwm = 0.5;
-            robot_state = kReadyForCommand;
-            break;
-        case kRightReceived:
-            current_command = kTurnRight;
-            steps_left = character * kStepsPerDegree;
-            steps_gone = 0;
-            LeftWheelForward();
-            RightWheelBack();
-            pwm_period = kInitialPwmPeriod;
-            pwm.period_us(pwm_period);
-            pwm = 0.5;
-            robot_state = kReadyForCommand;
-            break;
+}
+#elif STEP_COUNTER_TIMER
+// This is called when TIMER2 has counted up to one of its match registers:
+// MR1 when the robot has to start slowing down, MR0 when the move is over.
+void StepCounterHandler() {
+    PROFILE_ISR(kProfileStepCounterHandler);
+    MotionUpdate update;
+    if (LPC_TIM2->IR & TIM_IR_MR1) {
+        LPC_PWM1->MCR |= PWM_MR0_INTERRUPT;
+        LPC_TIM2->IR = TIM_IR_MR1;
+    }
+    if (LPC_TIM2->IR & TIM_IR_MR0) {
+        LPC_TIM2->IR = TIM_IR_MR0;
+        if (motion.command != kNone) {
+            FinishMove();
+        }
+    }
+}
+#endif
+
+// Tells PwmHandler that the gyro thinks the robot has hit something. Like
+// NotifyMotionQueued(), this leaves the actual work to PwmHandler.
+void NotifyCollision() {
+    collision_requests++;
+    NVIC_SetPendingIRQ(PWM1_IRQn);
+}
+
+// Tells PwmHandler that main() has counted kTurnSettleSamples since the robot
+// stopped at the end of a turn.
+void NotifyTurnSettled() {
+    settled_requests++;
+    NVIC_SetPendingIRQ(PWM1_IRQn);
+}
+
+// Tells PwmHandler that a move has been pushed onto the motion queue. Moves
+// are only ever started from PwmHandler, so that nothing else has to touch the
+// motion state whilst the robot might be moving.
+void NotifyMotionQueued() {
+    queue_requests++;
+    NVIC_SetPendingIRQ(PWM1_IRQn);
+}
+
+// This is called every time the mbed receives a character over serial. All it
+// does is stash the character for ProcessCommands() (in commands.cpp) to deal
+// with outside the interrupt, so that it never holds up a step interrupt.
+void SerialHandler() {
+    PROFILE_ISR(kProfileSerialHandler);
+    // When the last byte came in. The UART's FIFO can hold a few back, but
+    // not for anything like kFrameGapUs.
+    static uint32_t last_byte_at = 0;
+    uint32_t now = us_ticker_read();
+    bool after_gap = now - last_byte_at > kFrameGapUs;
+    last_byte_at = now;
+    while (usb_serial.readable()) {
+        SerialByte byte = {(char)usb_serial.getc(), after_gap};
+        after_gap = false;
+        if (!serial_rx.Push(byte)) {
+            serial_rx_dropped++;
+        }
     }
+    PostEvent(kEventSerialRx);
 }
\ No newline at end of file
@@ -11,22 +11,139 @@
 #ifndef JDH_16_17_RASPI3_INTERRUPT_HANDLERS_H_
 #define JDH_16_17_RASPI3_INTERRUPT_HANDLERS_H_
 
+#include <stdint.h>
+
+#include "ring_buffer.h"
+
 void PwmHandler();
 void ScaleSpeed();
 void SerialHandler();
-extern bool GyroTurnDetected;
-extern volatile int steps_left;
-extern volatile int continue_steps;
-extern int ignore_for;
+void StepCounterHandler();  // only with STEP_COUNTER_TIMER and not STEP_PERIOD_DMA
+void StepStreamHandler();  // only with STEP_PERIOD_DMA
+void NotifyMotionQueued();
+void NotifyCollision();
+void NotifyTurnSettled();
+// How many more steps the current move will take. For the step interrupts;
+// anything else should use ReadMotion().
+int StepsLeft();
+// How many steps the current move has taken so far. Likewise.
+int StepsGone();
 enum CurrentCommand {
     kNone,
     kMoveForward,
     kMoveBackward,
     kMoveLongDistance,
     kTurnLeft,
-    kTurnRight
+    kTurnRight,
+    kArcLeft,
+    kArcRight
+};
+
+// What the robot is doing. Only the step interrupts (PwmHandler,
+// StepCounterHandler and StepStreamHandler, which have the same priority and
+// so never interrupt each other) change it, and each of them adds one to
+// |sequence| on the way in and again on the way out, whatever else it changes
+// (the move being counted, the step counters and current_segment as well as
+// what's here). Anything else can read one field on its own whenever it
+// likes. To get several that agree with each other, use ReadMotion(), which
+// goes round again if a step interrupt got in the middle, rather than holding
+// them up by disabling interrupts.
+//
+// The other way, main() asks PwmHandler to do things with the Notify*()
+// functions, which only count requests up: nothing is written by both sides.
+struct MotionState {
+    uint32_t sequence;  // odd whilst a step interrupt is changing things
+    CurrentCommand command;
+    // A collision has stopped the current move; cleared when the next one
+    // starts from rest.
+    bool collided;
+    // Stopped at the end of a turn, waiting for main() to say that the gyro
+    // has caught up (see below).
+    bool checking_turn;
+    // There's a paused move (see TakePausedMove()).
+    bool paused;
+    // How many times the robot has stopped to check a turn, and how many
+    // moves have been paused, since it was switched on.
+    uint32_t turn_checks;
+    uint32_t pauses;
+    // The steps each wheel took in the moves before the current one, forwards
+    // positive.
+    int32_t left_wheel_steps;
+    int32_t right_wheel_steps;
+};
+extern volatile MotionState motion;
+
+// All from the same moment.
+struct MotionSnapshot {
+    CurrentCommand command;
+    bool collided;
+    bool checking_turn;
+    // In the current move, or 0 if there isn't one.
+    int steps_gone;
+    int steps_left;
+    // How many steps each wheel has taken since the robot was switched on,
+    // forwards positive. (For an arc, the inner wheel's steps in the current
+    // move are worked out from the outer wheel's.)
+    int32_t left_wheel_steps;
+    int32_t right_wheel_steps;
+    // The current move is low power (see MotionSegment).
+    bool low_power;
+};
+// Call from main(), never from an interrupt handler.
+void ReadMotion(MotionSnapshot* snapshot);
+
+// What was left of a move when a collision paused it: the robot slows down to
+// a stop within kMaxPauseSteps, and the steps it didn't get to are kept here
+// until the Pi carries on with them ('c'), or another move starts instead.
+struct PausedMove {
+    CurrentCommand command;
+    int steps;
+    bool low_power;  // as it was for the move (see MotionSegment)
+};
+// Takes the paused move, so that it can be queued again from rest; returns
+// false if there isn't one, or it has already been taken. Call from main().
+bool TakePausedMove(PausedMove* move);
+
+// Closed-loop turns. When a turn runs out of steps, the robot stops and
+// PwmHandler adds one to motion.turn_checks; main() then counts
+// kTurnSettleSamples gyro samples (so that the last of the turn has come
+// through the gyro's filter and FIFO) and calls NotifyTurnSettled(). If the
+// gyro says the turn is out by more than kTurnTolerance, PwmHandler trims it,
+// up to kMaxTurnTrims times, before replying.
+const int kTurnSettleSamples = 40;
+// Set by main() if the gyro is there; otherwise turns are open-loop.
+extern volatile bool turn_trim_enabled;
+// The robot's heading as main() has added it up from the gyro, anticlockwise
+// positive, in kGyroUnitsPerDegree. It wraps (modulo 2^32) after about 45
+// turns the same way, and 2^32 isn't a whole number of turns, so only the
+// differences mean anything: take them with YawSince(), which gets them
+// right as long as the robot has turned less than that in between (see
+// pose.cpp for keeping a heading).
+extern volatile int32_t yaw;
+// How far the robot has turned since yaw was |start|.
+inline int32_t YawSince(int32_t start) {
+    return (int32_t)((uint32_t)yaw - (uint32_t)start);
+}
+// How far the last turn was from what was asked for when it finished, in
+// kGyroUnitsPerDegree (positive means it should have gone further left).
+extern volatile int32_t last_turn_error;
+// How many steps the last turn really took per degree before it was trimmed,
+// going by the gyro (in Q16.16, like steps_per_degree), or 0 if it didn't
+// seem to turn at all.
+extern volatile uint32_t last_turn_steps_per_degree;
+
+// Must be a power of two. 128 bytes is about 11 ms at 115200 baud, and room
+// for the longest frame (see frames.h) with some to spare, so that what the Pi
+// sends whilst the robot is starting up can wait here until it's ready.
+const unsigned int kSerialRxBufferSize = 128;
+// A byte from the Pi, and whether it came more than kFrameGapUs (see
+// frames.h) after the one before it.
+struct SerialByte {
+    char character;
+    bool after_gap;
 };
-extern volatile CurrentCommand current_command;
-extern volatile CurrentCommand continue_command;
+extern RingBuffer<SerialByte, kSerialRxBufferSize> serial_rx;
+// Bytes that arrived when serial_rx was full, and so were thrown away.
+extern volatile int serial_rx_dropped;
 
 #endif  // JDH_16_17_RASPI3_INTERRUPT_HANDLERS_H_
\ No newline at end of file
@@ -0,0 +1,61 @@
+/* isr_profile.cpp
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+#include "isr_profile.h"
+
+#include <string.h>
+
+static IsrProfile profiles[kProfiledHandlers];
+
+void InitIsrProfile() {
+    memset(profiles, 0, sizeof(profiles));
+    for (int i = 0; i < kProfiledHandlers; i++) {
+        profiles[i].min_cycles = 0xffffffff;
+        profiles[i].min_interval = 0xffffffff;
+    }
+    // The cycle counter is part of the debug hardware, which has to be
+    // switched on first.
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+void RecordIsr(ProfiledHandler handler, uint32_t entry, uint32_t exit) {
+    IsrProfile& profile = profiles[handler];
+    uint32_t cycles = exit - entry;  // right even if CYCCNT wrapped
+    if (profile.calls > 0) {
+        uint32_t interval = entry - profile.last_entry;
+        if (interval < profile.min_interval) {
+            profile.min_interval = interval;
+        }
+        if (interval > profile.max_interval) {
+            profile.max_interval = interval;
+        }
+    }
+    profile.last_entry = entry;
+    profile.calls++;
+    profile.total_cycles += cycles;
+    if (cycles < profile.min_cycles) {
+        profile.min_cycles = cycles;
+    }
+    if (cycles > profile.max_cycles) {
+        profile.max_cycles = cycles;
+    }
+    // The highest set bit, with a single CLZ instruction.
+    int bin = cycles ? 31 - __CLZ(cycles) : 0;
+    if (bin >= kIsrHistogramBins) {
+        bin = kIsrHistogramBins - 1;
+    }
+    if (profile.histogram[bin] != 0xffff) {
+        profile.histogram[bin]++;
+    }
+}
+
+const IsrProfile& IsrProfileFor(ProfiledHandler handler) {
+    return profiles[handler];
+}
\ No newline at end of file
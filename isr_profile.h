@@ -0,0 +1,87 @@
+/* isr_profile.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// Times the interrupt handlers with the Cortex-M3's cycle counter (DWT
+// CYCCNT), which counts every cycle of the 96 MHz core clock, so that the
+// fastest safe step rate can be worked out from numbers rather than by
+// watching led_pwm_interrupt on a scope. Each handler that starts with
+// PROFILE_ISR() keeps a count, its shortest, longest and total time, a
+// histogram of its times, and the shortest and longest time between one call
+// and the next (for a handler that should run regularly, the difference is
+// its jitter). The Pi can ask for them with kOpIsrProfile and
+// kOpIsrHistogram (see frames.h).
+//
+// With ISR_PROFILING (in robot_specific.h) set to 0, PROFILE_ISR() is empty,
+// so the handlers don't pay anything for it.
+//
+// The interrupts all have the same priority, so they don't preempt each
+// other; if that changes, a handler's time will include the ones that
+// interrupted it.
+
+#ifndef JDH_16_17_RASPI3_ISR_PROFILE_H_
+#define JDH_16_17_RASPI3_ISR_PROFILE_H_
+
+#include <stdint.h>
+
+#include "mbed.h"
+#include "robot_specific.h"
+
+// The numbers the Pi asks for them by.
+enum ProfiledHandler {
+    kProfilePwmHandler,
+    kProfileStepCounterHandler,
+    kProfileStepStreamHandler,
+    kProfileScaleSpeed,
+    kProfileSerialHandler,
+    kProfileSerialTxHandler,
+    kProfileGyroDataReady,
+    kProfileBatteryHandler,
+    kProfiledHandlers
+};
+
+// Bin n of the histogram counts calls that took from 2^n up to 2^(n+1) - 1
+// cycles (at 96 MHz, bin 6 is 0.67 to 1.3 us); bin 0 also has calls that
+// took no cycles at all, and the last bin (from 341 us) everything longer.
+const int kIsrHistogramBins = 16;
+
+struct IsrProfile {
+    uint32_t calls;
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+    uint64_t total_cycles;
+    // Between the starts of consecutive calls. CYCCNT wraps every 44.7 s, so
+    // gaps longer than that come out wrong.
+    uint32_t min_interval;
+    uint32_t max_interval;
+    uint32_t last_entry;
+    uint16_t histogram[kIsrHistogramBins];  // sticks at 65535
+};
+
+// Starts the cycle counter, and forgets anything already recorded.
+void InitIsrProfile();
+// Adds a call to |handler| that started at |entry| and finished at |exit|
+// (both CYCCNT).
+void RecordIsr(ProfiledHandler handler, uint32_t entry, uint32_t exit);
+const IsrProfile& IsrProfileFor(ProfiledHandler handler);
+
+#if ISR_PROFILING
+// Times the rest of the block it's declared in, however that's left.
+class IsrTimer {
+  public:
+    explicit IsrTimer(ProfiledHandler handler) : handler_(handler), entry_(DWT->CYCCNT) {}
+    ~IsrTimer() {RecordIsr(handler_, entry_, DWT->CYCCNT);}
+  private:
+    ProfiledHandler handler_;
+    uint32_t entry_;
+};
+#define PROFILE_ISR(handler) IsrTimer isr_timer(handler)
+#else
+#define PROFILE_ISR(handler)
+#endif
+
+#endif  // JDH_16_17_RASPI3_ISR_PROFILE_H_
\ No newline at end of file
@@ -13,97 +13,264 @@
 #include "robot_specific.h"
 #include "interrupt_handlers.h"
 #include "pwm_constants.h"
-
-#include <MPU6050.h>
+#include "timer_constants.h"
+#include "motion_profile.h"
+#include "commands.h"
+#include "serial_tx.h"
+#include "step_stream.h"
+#include "gyro.h"
+#include "collision_detector.h"
+#include "gyro_bias.h"
+#include "isr_profile.h"
+#include "battery.h"
+#include "telemetry.h"
+#include "scheduler.h"
+#include "pose.h"
+#include "calibration.h"
 
 DigitalOut led_two(LED2);
 DigitalOut led_three(LED3);
-extern bool GyroTurnDetected = false;
-extern int ignore_for = 0;
-MPU6050 gyro(p28, p27);
+volatile int32_t yaw = 0;
 Serial log_mbed(p9, p10);
 
+// Any of the detectors in collision_detector.h will do here; run host/replay
+// on some gyro traces to see how they compare.
+CusumDetector collision_detector;
+// Everything below gets the gyro's samples through this, so that 0 means the
+// robot isn't turning.
+GyroBias gyro_bias;
+// Gyro samples to let go by before watching for collisions in the current
+// move. Only main() uses it.
+static int ignore_for = 0;
+static int16_t last_sample = 0;
+// The last of PwmHandler's stops at the end of a turn that main() has seen
+// (see motion.turn_checks), and the gyro samples still to come before it's
+// told that the gyro has caught up.
+static uint32_t turn_checks_seen = 0;
+static int turn_settle_samples = 0;
+
+// For kEventMoveStarted.
+static void StartWatching() {
+    ignore_for = kCollisionSettleSamples;
+}
+
+// For kEventGyroData: keeps the gyro's offset and yaw up to date, and looks
+// out for collisions and for the end of a turn.
+static void ProcessGyro() {
+    static int16_t samples[kGyroMaxBatchSamples];
+    int count = ReadGyro(samples, kGyroMaxBatchSamples);
+    for (int i = 0; i < count; i++) {
+        // The robot is only still when there's no move at all, including
+        // whilst a turn waits to be trimmed.
+        int16_t rate = gyro_bias.Update(samples[i], motion.command == kNone);
+        yaw = (int32_t)((uint32_t)yaw + (uint32_t)(kGyroLeftTurnSign * rate));
+        last_sample = rate;
+        uint32_t turn_checks = motion.turn_checks;
+        if (turn_checks != turn_checks_seen) {
+            turn_checks_seen = turn_checks;
+            turn_settle_samples = kTurnSettleSamples;
+        }
+        if (turn_settle_samples > 0) {
+            turn_settle_samples--;
+            if (turn_settle_samples == 0) {
+                NotifyTurnSettled();
+            }
+        }
+
+        if (ignore_for > 0) {
+            // Start afresh once the move has settled.
+            ignore_for--;
+            collision_detector.Reset();
+            continue;
+        }
+
+        if (collision_detector.Update(rate)) {
+            MotionSnapshot now;
+            ReadMotion(&now);
+            if ((now.command == kMoveForward)
+            || (now.command == kMoveBackward)
+            || (now.command == kMoveLongDistance)) {
+                if (!now.collided) {
+                    // PwmHandler stops the robot and remembers what was
+                    // left.
+                    NotifyCollision();
+                }
+            }
+        }
+    }
+}
+
+#if TELEMETRY
+static GyroTelemetry GyroState() {
+    GyroTelemetry gyro = {last_sample, collision_detector.Level(), ignore_for > 0};
+    return gyro;
+}
+
+#endif
+
+// For kEventBattery, which comes often enough for any telemetry period, and
+// for dead reckoning.
+static void KeepTrack() {
+    UpdatePose();
+#if TELEMETRY
+    UpdateTelemetry(GyroState());
+#endif
+}
+
+// For kEventMoveDone.
+static void MoveDone() {
+    CalibrationMoveDone();
+#if TELEMETRY
+    SendTelemetryNow(GyroState());
+#endif
+}
+
+// How long the gyro gets to have its offset learnt at start-up before the
+// robot gives up on it, in us.
+static const uint32_t kGyroStartUs = 500000;
+static uint32_t gyro_started_at = 0;
+
+// For kEventBattery until the robot is ready for commands: waits for the
+// motor boards to have power that has settled (see kPowerSettleMs), and for
+// the gyro's offset to have been learnt, whichever takes longer. Then it
+// enables the wheels, tells the Pi, and lets the commands that have come in
+// so far be carried out.
+static void WaitUntilReady() {
+    static const int kPowerLevel = (int)(kMotorPowerLevel * 65535);
+    static const int kPowerBand = (int)(kPowerSettleBand * 65535);
+    static int settling_level = 0;
+    static uint32_t settling_since = 0;
+    uint32_t now = us_ticker_read();
+    int level = BatteryLevel();
+    if (level < kPowerLevel || level > settling_level + kPowerBand
+        || level < settling_level - kPowerBand) {
+        settling_level = level;
+        settling_since = now;
+        led_three = level >= kPowerLevel;
+        return;
+    }
+    if (now - settling_since < (uint32_t)kPowerSettleMs * 1000) {
+        return;
+    }
+    if (turn_trim_enabled && !gyro_bias.settled()) {
+        if (now - gyro_started_at < kGyroStartUs) {
+            return;
+        }
+        // It answered, but the samples aren't coming (is p29 connected?), so
+        // it'll be no use for collisions or turns.
+        turn_trim_enabled = false;
+    }
+    left_wheel_enable = 1;
+    right_wheel_enable = 1;
+    led_two = 0;
+    led_three = 0;
+    InitPose(turn_trim_enabled);
+    SerialSend(kReadyByte);
+    SetTask(kEventBattery, &KeepTrack);
+    SetTask(kEventSerialRx, &ProcessCommands);
+    PostEvent(kEventSerialRx);  // for anything that's already waiting
+}
+
 int main() {
-    int oldest = 0;
-    int8_t buffer[1024] = { };
-    int mean;
-    int8_t GyZ, old_value;
-    int sum = 0;
     log_mbed.baud(115200);
+#if TELEMETRY
+    // Stream what the robot is doing out of p9 (see telemetry.h).
+    InitTelemetry();
+#endif
+#if ISR_PROFILING
+    InitIsrProfile();
+#endif
     
     // Disable both wheels to avoid current overload.
     left_wheel_enable = 0;
     right_wheel_enable = 0;
+    led_two = 1;
+
+    // Listen to the Pi straight away: the UART only holds 16 bytes, and
+    // anything sent from now on is kept in serial_rx until the robot is ready
+    // for it (see WaitUntilReady()).
+    usb_serial.baud(115200);
+    while (usb_serial.readable()) {
+         // Drain anything that came in at the wrong baud rate -- it can only
+         // be garbage.
+         usb_serial.getc();
+    }
+    // Attach SerialHandler to the serial receive interrupt.
+    usb_serial.attach(&SerialHandler);
+    // Replies go out from the transmit interrupt (see serial_tx.h).
+    usb_serial.attach(&SerialTxHandler, Serial::TxIrq);
+
+    // Work out the acceleration ramp before anything can try to move.
+    BuildMotionProfile();
+    // The same goes for how many steps make a centimetre and a degree.
+    LoadCalibration();
 
     // Initialise the PWM -- this must happen before enabling interrupts or we
     // get weird behaviour.
     pwm.period_ms(0);
     pwm.pulsewidth_ms(0);
+#if SEPARATE_STEP_CLOCKS
+    right_pwm.pulsewidth_ms(0);
+#endif
+#if STEP_PERIOD_DMA
+    // Count the steps and set their periods with TIMER2 and the GPDMA
+    // controller (see step_stream.h); p30 must be wired to p23.
+    InitStepStream();
+    NVIC_SetVector(DMA_IRQn, (uint32_t)&StepStreamHandler);
+    NVIC_EnableIRQ(DMA_IRQn);
+#elif STEP_COUNTER_TIMER
+    // Count the steps with TIMER2, from the pulses on p30 (which must be wired
+    // to p23): power it up, connect p30 to its CAP2.0 input, and have it count
+    // falling edges (the same moment that a match 4 interrupt would happen).
+    // It interrupts on MR0 (end of move) and MR1 (time to slow down).
+    LPC_SC->PCONP |= SC_PCONP_TIM2;
+    LPC_PINCON->PINSEL0 = (LPC_PINCON->PINSEL0 & ~(PINSEL0_P0_4_MASK))
+                          | PINSEL0_P0_4_CAP2_0;
+    LPC_TIM2->TCR = TIM_TCR_RESET;
+    LPC_TIM2->CTCR = TIM_CTCR_COUNT_FALLING_CAP0;
+    LPC_TIM2->PR = 0;
+    LPC_TIM2->MCR = TIM_MR0_INTERRUPT | TIM_MR1_INTERRUPT;
+    LPC_TIM2->TCR = TIM_TCR_ENABLE;
+    NVIC_SetVector(TIMER2_IRQn, (uint32_t)&StepCounterHandler);
+    NVIC_EnableIRQ(TIMER2_IRQn);
+    // PwmHandler switches its own interrupt on when there's a move to plan.
+#else
     // Enable interrupts for PWM match channel 4
     // The choice of channel 4 is arbitary; each channel is associated with one
     // of the pins on the mbed, and it happened that pin 23 was available, so we
     // decided to use channel 4. Changing this shouldn't stop the robot working
     // (as long as you physically connect the right pin per pwm.h).
     LPC_PWM1->MCR |= PWM_MR4_INTERRUPT | PWM_MR0_INTERRUPT;
+#endif
     // Attach handler to PWM interrupts
     NVIC_SetVector(PWM1_IRQn, (uint32_t)&PwmHandler);
     // Enable PWM interrupts
     NVIC_EnableIRQ(PWM1_IRQn);
 
-    // Enable acceleration -- if you want to disable acceleration (in order to
-    // show the robot off publicly), comment out this line.
+    // Watch the battery whilst accelerating. Acceleration itself is set by
+    // kMaxStepAcceleration -- if you want the robot to move gently (in order to
+    // show it off publicly), turn that and kMaxStepRate down.
     ticker.attach(&ScaleSpeed, 0.004);
 
-    usb_serial.baud(115200);
-    while (usb_serial.readable()) {
-         // Drain any spurious/garbage characters, just in case. If the Pi is
-         // trying to talk to us this early -- too bad.
-         usb_serial.getc();
-    }
-    // Attach SerialHandler to the serial receive interrupt.
-    usb_serial.attach(&SerialHandler);
+    // Keep the motor board voltage up to date in the background (see
+    // battery.h).
+    InitBattery();
+    NVIC_SetVector(ADC_IRQn, (uint32_t)&BatteryHandler);
+    NVIC_EnableIRQ(ADC_IRQn);
 
-    led_two = 1;
-    // Wait until the motor boards have power, then enable the motor boards.
-    while (battery_voltage.read() < 0.5);
-    led_three = 1;
-    wait_ms(1000);
-    left_wheel_enable = 1;
-    right_wheel_enable = 1;
-    led_two = 0;
-    led_three = 0;
+    // Start the gyro sampling now, so that its offset is learnt whilst
+    // waiting for the motor boards rather than after. If it isn't there,
+    // there won't be any samples, so nothing will ever count as a collision,
+    // and turns can't be checked.
+    turn_trim_enabled = InitGyro();
+    gyro_started_at = us_ticker_read();
 
-    while(1) {
-        old_value = buffer[oldest];
-        sum -= old_value;
-        GyZ = gyro.getGyroRawZ();
-        buffer[oldest] = GyZ;
-        sum += GyZ;
-        oldest++;
-        if (oldest >= 1024) {
-            oldest = 0;
-        }
-        
-        if (ignore_for > 0) {
-            ignore_for--;
-            continue;
-        }
-        
-        mean = sum / 1024;
-        //log_mbed.putc(mean);
-        if ((mean > 4) || (mean < -4)) { // threshold was 5, 2 is too low
-            if ((current_command == kMoveForward) 
-            || (current_command == kMoveBackward) 
-            || (current_command == kMoveLongDistance)) {
-                if (!GyroTurnDetected) {
-                    continue_command = current_command;
-                    continue_steps = steps_left;
-                    if (steps_left > 2) {
-                        steps_left = 2;
-                    }
-                }
-                GyroTurnDetected = true;
-            }
-        }
-    }
+    // From here on, main() only does anything when an interrupt handler asks
+    // it to (see scheduler.h). Until WaitUntilReady() says otherwise, there's
+    // nothing to do with the bytes from the Pi but keep them.
+    SetTask(kEventMoveStarted, &StartWatching);
+    SetTask(kEventGyroData, &ProcessGyro);
+    SetTask(kEventBattery, &WaitUntilReady);
+    SetTask(kEventMoveDone, &MoveDone);
+    RunScheduler();
 }
\ No newline at end of file
@@ -0,0 +1,178 @@
+/* motion_profile.cpp
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+#include "motion_profile.h"
+
+#include "mbed.h"
+
+#include "robot_specific.h"
+#include "pwm_constants.h"
+
+uint16_t step_periods[kMaxRampSteps];
+int ramp_steps = 1;
+volatile int ramp_limit = 1;
+volatile int profile_step = 0;
+volatile int ramp_rate = 256;
+volatile int profile_fraction = 0;
+
+// kStallLevel and kFullTorqueLevel, in the units of battery.h.
+static int stall_level = 0;
+static int full_torque_level = 1;
+// The speed of step_periods[0], in steps per second.
+static int start_step_rate = 1;
+
+// How finely to integrate the S-curve, in seconds. This only runs at startup,
+// so it can afford to be fine.
+const double kJerkTimeStep = 0.00002;
+
+const double kTicksPerSecond = PWM_TICKS_PER_US * 1000000.0;
+
+// Converts a step duration in seconds to PWM ticks, never going faster than the
+// top speed.
+static uint16_t ToTicks(double seconds, int shortest) {
+    int ticks = (int)(seconds * kTicksPerSecond + 0.5);
+    return ticks < shortest ? shortest : ticks;
+}
+
+// Constant acceleration from the starting speed: the time taken to cover s
+// steps is (sqrt(v0^2 + 2as) - v0) / a.
+static void BuildTrapezoid(double start_rate, int shortest) {
+    double accel = kMaxStepAcceleration;
+    double last = 0;
+    ramp_steps = kMaxRampSteps;
+    for (int i = 0; i < kMaxRampSteps; i++) {
+        double t = (sqrt(start_rate * start_rate + 2 * accel * (i + 1)) - start_rate) / accel;
+        step_periods[i] = ToTicks(t - last, shortest);
+        last = t;
+        if (step_periods[i] == shortest) {
+            ramp_steps = i + 1;
+            break;
+        }
+    }
+}
+
+// The acceleration rises at kMaxStepJerk up to kMaxStepAcceleration, and falls
+// again in time to arrive at the top speed with no acceleration left. There's
+// no neat closed form for the time of each step, so integrate it.
+static void BuildSCurve(double start_rate, int shortest) {
+    double top_rate = kMaxStepRate;
+    double jerk = kMaxStepJerk;
+    double rate = start_rate;
+    double accel = 0;
+    double position = 0;
+    double t = 0;
+    double last = 0;
+    int i = 0;
+    while (i < kMaxRampSteps && rate < top_rate) {
+        if (rate + accel * accel / (2 * jerk) >= top_rate) {
+            accel -= jerk * kJerkTimeStep;
+            if (accel <= 0) {
+                break;  // as fast as we're going to go
+            }
+        } else if (accel < kMaxStepAcceleration) {
+            accel += jerk * kJerkTimeStep;
+            if (accel > kMaxStepAcceleration) {
+                accel = kMaxStepAcceleration;
+            }
+        }
+        rate += accel * kJerkTimeStep;
+        position += rate * kJerkTimeStep;
+        t += kJerkTimeStep;
+        while (position >= i + 1 && i < kMaxRampSteps) {
+            // Interpolate back to when the step was actually crossed.
+            double crossed = t - (position - (i + 1)) / rate;
+            step_periods[i++] = ToTicks(crossed - last, shortest);
+            last = crossed;
+        }
+    }
+    if (i < kMaxRampSteps) {
+        step_periods[i++] = shortest;  // cruise
+    }
+    ramp_steps = i;
+}
+
+// Fills in step_periods from the limits in robot_specific.cpp. Uses doubles,
+// so don't call it from an interrupt.
+void BuildMotionProfile() {
+    double start_rate = 1000000.0 / kInitialPwmPeriod;
+    int shortest = (int)(kTicksPerSecond / kMaxStepRate);
+    if (kMaxStepJerk > 0) {
+        BuildSCurve(start_rate, shortest);
+    } else {
+        BuildTrapezoid(start_rate, shortest);
+    }
+    ramp_limit = ramp_steps;
+    start_step_rate = (int)start_rate;
+    stall_level = (int)(kStallLevel * 65535);
+    full_torque_level = (int)(kFullTorqueLevel * 65535);
+    if (full_torque_level <= stall_level) {
+        full_torque_level = stall_level + 1;
+    }
+}
+
+// How much torque the motors have to spare with the supply at |level|, in
+// 256ths: none at kStallLevel, where they can only just turn at the starting
+// speed, up to all of it at kFullTorqueLevel.
+static int TorqueMargin(uint16_t level) {
+    if (level <= stall_level) {
+        return 0;
+    }
+    if (level >= full_torque_level) {
+        return 256;
+    }
+    return (level - stall_level) * 256 / (full_torque_level - stall_level);
+}
+
+// The back EMF of the motors goes up with speed, and the supply has to
+// overcome it to drive current through them, so the top speed scales with
+// the margin. The table is in order of speed, so find the first entry that's
+// too fast.
+int SupplyRampLimit(uint16_t level) {
+    int margin = TorqueMargin(level);
+    if (margin == 256) {
+        return ramp_steps;
+    }
+    int rate = start_step_rate + (kMaxStepRate - start_step_rate) * margin / 256;
+    int period = PWM_TICKS_PER_US * 1000000 / rate;
+    int low = 1;
+    int high = ramp_steps;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (step_periods[middle] < period) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return low;
+}
+
+int StartProfile(uint16_t level) {
+    ramp_limit = SupplyRampLimit(level);
+#if STEP_PERIOD_DMA
+    ramp_rate = 256;
+#else
+    // The torque to spare is what speeds the robot up, so the acceleration
+    // scales with it too (but never all the way to none, or it would never
+    // stop).
+    int margin = TorqueMargin(level);
+    ramp_rate = margin < 16 ? 16 : margin;
+#endif
+    profile_step = 0;
+    profile_fraction = 0;
+    return step_periods[0];
+}
+
+void LimitAcceleration(int steps) {
+    if (steps < 1) {
+        steps = 1;
+    }
+    if (steps < ramp_limit) {
+        ramp_limit = steps;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+/* motion_profile.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// Works out how long each step of a move should take, so that the robot
+// speeds up and slows down at a constant rate (or, with kMaxStepJerk set, along
+// an S-curve) instead of changing the PWM period by a fixed amount every tick.
+//
+// Since every move starts and ends at rest with the same limits, one table of
+// step periods from standstill up to kMaxStepRate does for all of them. The
+// move keeps track of how far up the table it is (profile_step), going up one
+// entry per step whilst it can, but never further up than the number of steps
+// left before it has to stop -- so step n from the end takes as long as entry
+// n. A move too short to reach top speed just uses less of the table, which is
+// the time-optimal triangular profile. The table is built once at startup by
+// BuildMotionProfile().
+//
+// How fast and how hard the motors can go depends on the supply: as the
+// battery runs down, the motors have less torque to spare, especially at
+// speed. So each move gets a top speed (ramp_limit) and an acceleration
+// (ramp_rate, which walks the table more slowly) scaled to the supply when it
+// starts, between kStallLevel and kFullTorqueLevel; and ScaleSpeed keeps the
+// top speed down if the supply sags on the way. With STEP_PERIOD_DMA, the DMA
+// walks the table a whole entry per step, so only the top speed changes.
+
+#ifndef JDH_16_17_RASPI3_MOTION_PROFILE_H_
+#define JDH_16_17_RASPI3_MOTION_PROFILE_H_
+
+#include <stdint.h>
+
+// The longest ramp the table can hold; if kMaxStepRate and
+// kMaxStepAcceleration need more than this, the top speed is reduced to fit.
+const int kMaxRampSteps = 4096;
+
+// Step periods in PWM ticks (see PWM_TICKS_PER_US), indexed by how many steps
+// the robot is from standing still.
+extern uint16_t step_periods[kMaxRampSteps];
+// How much of step_periods is in use.
+extern int ramp_steps;
+// How far up the ramp the current move is allowed to go.
+extern volatile int ramp_limit;
+// Where in step_periods the step most recently planned is.
+extern volatile int profile_step;
+// How far up the table the current move goes for each step, in 256ths: the
+// fraction of kMaxStepAcceleration it speeds up and slows down at. Pausing a
+// move (see interrupt_handlers.cpp) can raise it, to as much as 16 * 256.
+extern volatile int ramp_rate;
+// How far past profile_step the move has got, in 256ths of an entry.
+extern volatile int profile_fraction;
+
+void BuildMotionProfile();
+// Call before starting a move from rest, with the supply at |level| (see
+// battery.h); returns the period of its first step.
+int StartProfile(uint16_t level);
+// Stop the current move speeding up once it is |steps| steps up the ramp.
+void LimitAcceleration(int steps);
+// The furthest up the ramp the motors can be trusted to go with the supply at
+// |level|.
+int SupplyRampLimit(uint16_t level);
+
+// How many steps it takes to slow down from the top of the ramp.
+inline int BrakingSteps() {
+    return (ramp_limit * 256 + ramp_rate - 1) / ramp_rate;
+}
+
+// The period, in PWM ticks, of the next step of a move, when there will be
+// |to_end| more steps after that one before the robot has to stop. Call once
+// per step. Cheap enough to call from the PWM interrupt.
+inline int NextStepPeriod(int to_end) {
+    int target = ramp_limit - 1;
+    // Slowing down at ramp_rate, step n from the end is n * ramp_rate / 256
+    // up the table. (Any further away than 2^19 steps is on the flat anyway,
+    // even at the 16 entries a step a paused move can slow down at.)
+    if (to_end < (1 << 19)) {
+        int braking = to_end < 0 ? 0 : to_end * ramp_rate >> 8;
+        if (braking < target) {
+            target = braking;
+        }
+    }
+    if (profile_step < target) {
+        profile_fraction += ramp_rate;
+        profile_step += profile_fraction >> 8;
+        profile_fraction &= 0xFF;
+        if (profile_step > target) {
+            profile_step = target;
+        }
+    } else {
+        // Either cruising, or slowing down (or stopping early, in which case
+        // this jumps straight down).
+        profile_step = target;
+    }
+    return step_periods[profile_step];
+}
+
+#endif  // JDH_16_17_RASPI3_MOTION_PROFILE_H_
\ No newline at end of file
@@ -0,0 +1,112 @@
+/* motion_queue.cpp
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+#include "motion_queue.h"
+
+#include "frames.h"
+
+static MotionSegment segments[kMotionQueueSize];
+// head is the next segment to pop, tail is where the next push goes. They are
+// allowed to run freely and wrap; the queue is empty when they're equal.
+static volatile unsigned int head = 0;
+static volatile unsigned int tail = 0;
+
+MotionSegment MakeSegment(CurrentCommand command, int steps) {
+    MotionSegment segment;
+    segment.command = command;
+    segment.steps = steps;
+    segment.inner_steps = steps;
+    segment.low_power = false;
+    segment.tag = kUntagged;
+    switch (command) {
+        case kMoveBackward:
+            segment.left_forward = false;
+            segment.right_forward = false;
+            break;
+        case kTurnLeft:
+            segment.left_forward = false;
+            segment.right_forward = true;
+            break;
+        case kTurnRight:
+            segment.left_forward = true;
+            segment.right_forward = false;
+            break;
+        default:  // kMoveForward, kMoveLongDistance, and arcs
+            segment.left_forward = true;
+            segment.right_forward = true;
+            break;
+    }
+    return segment;
+}
+
+MotionSegment MakeArc(CurrentCommand command, int outer_steps, int inner_steps) {
+    MotionSegment segment = MakeSegment(command, outer_steps);
+    segment.inner_steps = inner_steps < 0 ? -inner_steps : inner_steps;
+    if (command == kArcLeft) {
+        segment.left_forward = inner_steps >= 0;
+    } else {
+        segment.right_forward = inner_steps >= 0;
+    }
+    return segment;
+}
+
+bool ContinuesWithoutReversal(const MotionSegment& from, const MotionSegment& to) {
+    return from.left_forward == to.left_forward
+           && from.right_forward == to.right_forward
+           && from.low_power == to.low_power
+           && !IsArc(from) && !IsArc(to);
+}
+
+bool PushSegment(const MotionSegment& segment) {
+    if (tail - head >= (unsigned int)kMotionQueueSize) {
+        return false;
+    }
+    segments[tail % kMotionQueueSize] = segment;
+    __DMB();  // the whole move has to be there before PwmHandler can see it
+    tail++;
+    return true;
+}
+
+bool PopSegment(MotionSegment* segment) {
+    if (head == tail) {
+        return false;
+    }
+    __DMB();
+    *segment = segments[head % kMotionQueueSize];
+    __DMB();  // and it has to have been copied before main() can reuse the slot
+    head++;
+    return true;
+}
+
+bool SegmentsQueued() {
+    return head != tail;
+}
+
+int StepsWithoutReversal(const MotionSegment& current) {
+    int steps = 0;
+    for (unsigned int i = head; i != tail; i++) {
+        const MotionSegment& next = segments[i % kMotionQueueSize];
+        if (!ContinuesWithoutReversal(current, next)) {
+            break;
+        }
+        steps += next.steps;
+    }
+    return steps;
+}
+
+int LengthsWithoutReversal(const MotionSegment& current, int* lengths, int max_lengths) {
+    int count = 0;
+    for (unsigned int i = head; i != tail && count < max_lengths; i++) {
+        const MotionSegment& next = segments[i % kMotionQueueSize];
+        if (!ContinuesWithoutReversal(current, next)) {
+            break;
+        }
+        lengths[count++] = next.steps;
+    }
+    return count;
+}
\ No newline at end of file
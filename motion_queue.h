@@ -0,0 +1,74 @@
+/* motion_queue.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// Moves that the Pi has sent but which haven't started yet. Whilst the robot
+// is moving, the next queued move is looked at to decide whether to slow
+// down: if neither wheel has to change direction between them, the robot
+// carries straight on into the next move at full speed, and only stops when
+// a wheel actually has to reverse, when only one of the moves is low power
+// ('A'), or when the queue runs out. Arcs always start and end at rest, since
+// the inner wheel would otherwise have to change speed all at once.
+//
+// Moves are pushed from main() (by ProcessCommands()) and popped from the PWM
+// interrupt, so, like RingBuffer, it's safe without disabling interrupts as
+// long as each side sticks to its own functions.
+
+#ifndef JDH_16_17_RASPI3_MOTION_QUEUE_H_
+#define JDH_16_17_RASPI3_MOTION_QUEUE_H_
+
+#include "interrupt_handlers.h"
+
+// How many moves can be waiting. Must be a power of two.
+const int kMotionQueueSize = 8;
+
+struct MotionSegment {
+    CurrentCommand command;
+    // The steps the outer wheel takes (either wheel, except for an arc).
+    int steps;
+    // The steps the inner wheel of an arc takes whilst the outer one takes
+    // |steps|; the same as |steps| for everything else.
+    int inner_steps;
+    bool left_forward;
+    bool right_forward;
+    // Whether the robot should go no faster than it could on a supply at
+    // kLowPowerLevel ('A').
+    bool low_power;
+    // The sequence number to send back when it's finished, if it came in a
+    // frame (see frames.h); otherwise kUntagged.
+    int tag;
+};
+
+// Fills in which way the wheels turn for |command|.
+MotionSegment MakeSegment(CurrentCommand command, int steps);
+// An arc (kArcLeft or kArcRight), with the outer wheel taking |outer_steps|
+// forwards. If |inner_steps| is negative, the inner wheel goes backwards.
+MotionSegment MakeArc(CurrentCommand command, int outer_steps,
+                      int inner_steps);
+// Whether |segment| is an arc, i.e. the wheels take different numbers of
+// steps.
+inline bool IsArc(const MotionSegment& segment) {
+    return segment.inner_steps != segment.steps;
+}
+// Whether the wheels can go straight from |from| into |to| without stopping.
+bool ContinuesWithoutReversal(const MotionSegment& from,
+                              const MotionSegment& to);
+
+// Returns false (and queues nothing) if the queue is full.
+bool PushSegment(const MotionSegment& segment);
+// Returns false if the queue is empty.
+bool PopSegment(MotionSegment* segment);
+bool SegmentsQueued();
+// The number of steps in the queued moves that |current| can run straight
+// into, i.e. how far the robot can go before it must stop.
+int StepsWithoutReversal(const MotionSegment& current);
+// The same, but one by one: fills in |lengths| with the steps in each of
+// those moves (up to |max_lengths| of them) and returns how many there are.
+int LengthsWithoutReversal(const MotionSegment& current, int* lengths,
+                           int max_lengths);
+
+#endif  // JDH_16_17_RASPI3_MOTION_QUEUE_H_
\ No newline at end of file
@@ -0,0 +1,47 @@
+/* mpu6050_constants.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+#ifndef JDH_16_17_RASPI3_MPU6050_CONSTANTS_H_
+#define JDH_16_17_RASPI3_MPU6050_CONSTANTS_H_
+
+// Register map: <https://www.invensense.com/wp-content/uploads/2015/02/MPU-6000-Register-Map1.pdf>
+// The MPU6050 library only has names for the registers its own functions use,
+// so the rest of the ones we need are here. They're prefixed GYRO_ rather than
+// MPU6050_ so that they can't clash with the library's.
+
+// Sample rate = gyro output rate / (1 + SMPLRT_DIV) (register map section 4.2).
+// The gyro output rate is 1 kHz whenever the low-pass filter is on.
+#define GYRO_SMPLRT_DIV_REG 0x19
+// DLPF_CFG is bits 0-2 of CONFIG (section 4.3).
+#define GYRO_CONFIG_REG 0x1A
+#define GYRO_DLPF_98HZ 2  /* 1 kHz output rate, 2.8 ms delay */
+// FS_SEL is bits 3-4 of GYRO_CONFIG (section 4.4); 0 is +-250 degrees/s, which
+// is 131 per degree/s.
+#define GYRO_GYRO_CONFIG_REG 0x1B
+#define GYRO_FS_250 0<<3
+// Which measurements are written into the FIFO (section 4.6).
+#define GYRO_FIFO_EN_REG 0x23
+#define GYRO_FIFO_EN_ZG 1<<4
+// INT pin behaviour (section 4.15). Left at 0, the pin pulses high for 50 us
+// for each interrupt, so it never needs clearing.
+#define GYRO_INT_PIN_CFG_REG 0x37
+#define GYRO_INT_ENABLE_REG 0x38
+#define GYRO_INT_DATA_RDY_EN 1<<0
+#define GYRO_USER_CTRL_REG 0x6A
+#define GYRO_USER_CTRL_FIFO_EN 1<<6
+#define GYRO_USER_CTRL_FIFO_RESET 1<<2  /* clears itself */
+#define GYRO_PWR_MGMT_1_REG 0x6B
+#define GYRO_CLKSEL_PLL_ZGYRO 3  /* more stable than the internal oscillator */
+// FIFO_COUNT is big-endian, high byte first; reading FIFO_R_W repeatedly in one
+// burst empties the FIFO (sections 4.30 and 4.31). Samples in it are
+// big-endian too.
+#define GYRO_FIFO_COUNTH_REG 0x72
+#define GYRO_FIFO_R_W_REG 0x74
+#define GYRO_FIFO_SIZE 1024
+
+#endif  // JDH_16_17_RASPI3_MPU6050_CONSTANTS_H_
\ No newline at end of file
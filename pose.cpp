@@ -0,0 +1,198 @@
+/* pose.cpp
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+#include "pose.h"
+
+#include <math.h>
+
+#include "mbed.h"
+
+#include "robot_specific.h"
+#include "interrupt_handlers.h"
+#include "gyro.h"
+#include "frames.h"
+#include "calibration.h"
+
+// A whole turn, in kGyroUnitsPerDegree.
+const int32_t kGyroUnitsPerTurn = 360 * kGyroUnitsPerDegree;
+// 2^48 / kGyroUnitsPerTurn: multiplying by this and dropping 32 bits turns
+// part of a turn in kGyroUnitsPerDegree into 65536ths of a turn, without a
+// division.
+const uint32_t kAngleScale = (uint32_t)((1ULL << 48) / kGyroUnitsPerTurn);
+
+const double kPi = 3.14159265358979;
+
+// sin() over the first quarter of a turn, in 256 pieces, in Q14.
+static int16_t quarter_sine[257];
+
+static bool gyro_heading = false;
+// Where the robot is, in 256ths of a step (good for the best part of a
+// kilometre), and which way it's facing, in kGyroUnitsPerDegree from 0 up to
+// kGyroUnitsPerTurn. 2^32 isn't a whole number of turns, so the heading is
+// kept within one and only ever has the change since the last update added
+// to it; yaw can wrap as often as it likes.
+static int32_t x = 0;
+static int32_t y = 0;
+static int32_t heading = 0;
+// What RawHeading() said at the last update.
+static int32_t last_raw_heading = 0;
+// The wheels' steps at the last update (see ReadMotion()).
+static int32_t last_left = 0;
+static int32_t last_right = 0;
+static uint32_t updated_at = 0;
+// SetPosePeriod().
+static uint32_t period_us = 0;
+static uint32_t next_due = 0;
+static bool was_moving = false;
+
+// Which way the robot is facing, going by the gyro or by the wheels, in
+// kGyroUnitsPerDegree modulo 2^32: only the change from one call to the next
+// means anything, and that's right as long as it's less than half of 2^32
+// (about 45 turns).
+static int32_t RawHeading(int32_t left, int32_t right) {
+    if (gyro_heading) {
+        return yaw;
+    }
+    // Half the difference between the wheels is how far each has gone round
+    // the circle the robot turns on the spot in.
+    int64_t turned = (int64_t)(right - left) * kGyroUnitsPerDegree * 65536 / 2
+                     / steps_per_degree;
+    return (int32_t)(uint32_t)turned;
+}
+
+// |turn| (in kGyroUnitsPerDegree) as part of the way round from 0 to
+// kGyroUnitsPerTurn.
+static int32_t WithinTurn(int32_t turn) {
+    int32_t within = turn % kGyroUnitsPerTurn;
+    return within < 0 ? within + kGyroUnitsPerTurn : within;
+}
+
+// |turn| in 65536ths of a turn.
+static uint16_t BinaryAngle(int32_t turn) {
+    return (uint16_t)(((uint64_t)WithinTurn(turn) * kAngleScale) >> 32);
+}
+
+// Q14, for |angle| in 65536ths of a turn.
+static int32_t Sine(uint16_t angle) {
+    unsigned int within = angle & 0x3FFF;
+    if (angle & 0x4000) {
+        within = 0x4000 - within;  // on the way back down
+    }
+    unsigned int i = within >> 6;
+    int32_t value = quarter_sine[i];
+    if (i < 256) {
+        value += (quarter_sine[i + 1] - value) * (int32_t)(within & 63) >> 6;
+    }
+    return (angle & 0x8000) ? -value : value;
+}
+
+static int32_t Cosine(uint16_t angle) {
+    return Sine((uint16_t)(angle + 0x4000));
+}
+
+// From 256ths of a step to millimetres, and back.
+static int32_t ToMillimetres(int32_t distance) {
+    return (int32_t)((int64_t)distance * 2560 / (int32_t)steps_per_centimetre);
+}
+
+static int32_t FromMillimetres(int32_t millimetres) {
+    return ScaleQ16((int64_t)millimetres * 256, steps_per_centimetre, 10);
+}
+
+void InitPose(bool use_gyro) {
+    for (int i = 0; i <= 256; i++) {
+        quarter_sine[i] = (int16_t)floor(16384 * sin(i * kPi / 512) + 0.5);
+    }
+    gyro_heading = use_gyro;
+    MotionSnapshot now;
+    ReadMotion(&now);
+    last_left = now.left_wheel_steps;
+    last_right = now.right_wheel_steps;
+    last_raw_heading = RawHeading(last_left, last_right);
+    heading = 0;
+    updated_at = us_ticker_read();
+}
+
+// Sends a 'W' frame if one is due; |moving| is whether there's a move going.
+static void PushPose(bool moving) {
+    bool stopped = was_moving && !moving;
+    was_moving = moving;
+    if (period_us == 0 || !(moving || stopped)) {
+        return;
+    }
+    if (!stopped && (int32_t)(updated_at - next_due) < 0) {
+        return;
+    }
+    next_due = updated_at + period_us;
+    uint8_t bytes[kPoseData];
+    WritePose(bytes, CurrentPose());
+    SendFrame('W', kUntagged, bytes, kPoseData);
+}
+
+void UpdatePose() {
+    // The steps and whether there's a move going have to agree, or the last
+    // 'W' of a move could be sent before its last steps were counted.
+    MotionSnapshot now;
+    ReadMotion(&now);
+    int32_t left = now.left_wheel_steps;
+    int32_t right = now.right_wheel_steps;
+    int32_t raw_heading = RawHeading(left, right);
+    int32_t turned = (int32_t)((uint32_t)raw_heading
+                               - (uint32_t)last_raw_heading);
+    last_raw_heading = raw_heading;
+    // Twice the distance the middle of the robot has gone, in steps.
+    int32_t moved = (left - last_left) + (right - last_right);
+    if (moved != 0) {
+        uint16_t angle = BinaryAngle(heading + turned / 2);
+        // Halving |moved| and making it 256ths of a step is 128 times, which
+        // comes off the Q14 sine and cosine's 16384.
+        x += (moved * Cosine(angle) + 64) >> 7;
+        y += (moved * Sine(angle) + 64) >> 7;
+    }
+    heading = WithinTurn(heading + turned % kGyroUnitsPerTurn);
+    last_left = left;
+    last_right = right;
+    updated_at = us_ticker_read();
+    PushPose(now.command != kNone);
+}
+
+Pose CurrentPose() {
+    Pose pose;
+    pose.x = ToMillimetres(x);
+    pose.y = ToMillimetres(y);
+    int32_t within = heading;
+    if (within >= kGyroUnitsPerTurn / 2) {
+        within -= kGyroUnitsPerTurn;
+    }
+    pose.heading = (int16_t)(within / (kGyroUnitsPerDegree / 100));
+    pose.left_steps = last_left;
+    pose.right_steps = last_right;
+    pose.timestamp = updated_at;
+    return pose;
+}
+
+void SetPose(int32_t new_x, int32_t new_y, int32_t new_heading) {
+    UpdatePose();  // so that the steps so far count from where it was
+    x = FromMillimetres(new_x);
+    y = FromMillimetres(new_y);
+    heading = WithinTurn(new_heading * (kGyroUnitsPerDegree / 100));
+}
+
+void SetPosePeriod(int ms) {
+    period_us = ms > 0 ? ms * 1000 : 0;
+    next_due = us_ticker_read();
+}
+
+uint8_t* WritePose(uint8_t* bytes, const Pose& pose) {
+    bytes = Write32(bytes, pose.x);
+    bytes = Write32(bytes, pose.y);
+    bytes = Write16(bytes, (uint16_t)pose.heading);
+    bytes = Write32(bytes, pose.left_steps);
+    bytes = Write32(bytes, pose.right_steps);
+    return Write32(bytes, pose.timestamp);
+}
\ No newline at end of file
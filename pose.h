@@ -0,0 +1,66 @@
+/* pose.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// Dead reckoning: where the robot is and which way it's facing, relative to
+// where it was switched on (or wherever the Pi last said it was), so that the
+// Pi can tell how far a move has got -- or how far it got before a collision
+// -- without stopping to look around. main() calls UpdatePose() often. The
+// distance comes from the steps the wheels have taken (see ReadMotion()), and
+// the heading from the gyro, since the wheels slip when turning on the spot
+// and the gyro doesn't notice; without a gyro, the heading comes from the
+// difference between the wheels instead.
+//
+// It's all in integers. Between updates the robot is taken to have gone along
+// a straight line, pointing halfway between the headings at either end of it
+// (which is exactly right for an arc of a circle), and sines come from a
+// table.
+//
+// A pose goes in a frame (see frames.h) as kPoseData bytes:
+//     x and y, in mm (32 bits each, signed); x is forwards from where the
+//     robot started, y to its left
+//     heading, in hundredths of a degree anticlockwise, -18000 to 17999
+//     (16 bits, signed)
+//     the steps each wheel has taken altogether, forwards positive (32 bits
+//     each, signed: left, then right)
+//     when it was worked out, from us_ticker_read() (32 bits)
+// With SetPosePeriod(), main() also sends one, as a 'W' frame without a
+// sequence number, every so often whilst the robot is moving, and once more
+// when it stops.
+
+#ifndef JDH_16_17_RASPI3_POSE_H_
+#define JDH_16_17_RASPI3_POSE_H_
+
+#include <stdint.h>
+
+const int kPoseData = 22;
+
+struct Pose {
+    int32_t x;  // mm
+    int32_t y;  // mm
+    int16_t heading;  // hundredths of a degree
+    int32_t left_steps;
+    int32_t right_steps;
+    uint32_t timestamp;
+};
+
+// Call once the gyro has been started, saying whether it's there.
+void InitPose(bool use_gyro);
+// Catches up with the steps taken and the gyro since the last call, and sends
+// a 'W' frame if one is due.
+void UpdatePose();
+// As of the last UpdatePose().
+Pose CurrentPose();
+// Makes the robot be at |x|, |y| (mm), facing |heading| (hundredths of a
+// degree), e.g. when the Pi has seen where it is.
+void SetPose(int32_t x, int32_t y, int32_t heading);
+// How often to send 'W' frames whilst moving, in ms; 0 for none (the default).
+void SetPosePeriod(int ms);
+// Puts |pose| into |bytes| (as above) and returns where the next value goes.
+uint8_t* WritePose(uint8_t* bytes, const Pose& pose);
+
+#endif  // JDH_16_17_RASPI3_POSE_H_
\ No newline at end of file
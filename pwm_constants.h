@@ -55,4 +55,19 @@
 #define PWM_MR5_INTERRUPT 1<<15
 #define PWM_MR6_INTERRUPT 1<<18
 
+// Load enable bits for PWM LER (Latch Enable Register) (datasheet section
+// 24.6.7). Writes to the match registers only take effect at the start of the
+// next period if the matching bit is set here, so a new period and pulse width
+// can be written at any point during the current period:
+//     LPC_PWM1->MR0 = period;
+//     LPC_PWM1->MR4 = period / 2;
+//     LPC_PWM1->LER = PWM_LER_MR0 | PWM_LER_MR4;
+#define PWM_LER_MR0 1<<0
+#define PWM_LER_MR3 1<<3
+#define PWM_LER_MR4 1<<4
+
+// mbed runs the PWM from PCLK = CCLK / 4 = 24 MHz with no prescaling, so this
+// is how many counts of the PWM timer there are in a microsecond.
+#define PWM_TICKS_PER_US 24
+
 #endif  // JDH_16_17_RASPI3_PWM_CONSTANTS_H_
\ No newline at end of file
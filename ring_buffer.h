@@ -0,0 +1,63 @@
+/* ring_buffer.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// A fixed-size FIFO for passing things from exactly one producer to exactly
+// one consumer, where one of them is an interrupt handler and the other is
+// main() (or another interrupt that can't preempt the first). Neither side
+// ever has to disable interrupts: only the producer writes tail_ and only the
+// consumer writes head_, and on the Cortex-M3 an aligned word store is atomic.
+// items_ isn't volatile, so a barrier keeps the compiler (and the processor)
+// from moving the copy of an item past the store that hands it over.
+
+#ifndef JDH_16_17_RASPI3_RING_BUFFER_H_
+#define JDH_16_17_RASPI3_RING_BUFFER_H_
+
+#include "mbed.h"
+
+// N must be a power of two, so that the indices can wrap freely.
+template <typename T, unsigned int N>
+class RingBuffer {
+  public:
+    RingBuffer() : head_(0), tail_(0) {}
+
+    // Producer only. Returns false (and stores nothing) if the buffer is full.
+    bool Push(T item) {
+        unsigned int tail = tail_;
+        if (tail - head_ >= N) {
+            return false;
+        }
+        items_[tail % N] = item;
+        __DMB();
+        tail_ = tail + 1;  // publish only once the item is in place
+        return true;
+    }
+
+    // Consumer only. Returns false if the buffer is empty.
+    bool Pop(T* item) {
+        unsigned int head = head_;
+        if (head == tail_) {
+            return false;
+        }
+        __DMB();  // nor read it before seeing that it's there
+        *item = items_[head % N];
+        __DMB();
+        head_ = head + 1;  // and only give the slot back once it's been read
+        return true;
+    }
+
+    // Either side; may be out of date by the time it's used.
+    unsigned int Count() const {return tail_ - head_;}
+    bool Empty() const {return head_ == tail_;}
+
+  private:
+    T items_[N];
+    volatile unsigned int head_;
+    volatile unsigned int tail_;
+};
+
+#endif  // JDH_16_17_RASPI3_RING_BUFFER_H_
\ No newline at end of file
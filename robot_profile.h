@@ -0,0 +1,62 @@
+/* robot_profile.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// Works out how many steps make a centimetre and a degree from the size of a
+// robot, at compile time. The LPC1768 has no FPU, so doing it in doubles meant
+// a software floating point multiply for every command, inside SerialHandler.
+// Instead, everything is kept in integers: lengths are in micrometres, and the
+// answers are Q16.16 fixed point (65536 is one step), which is plenty -- even
+// for 'F' 255 it's less than a tenth of a step out.
+//
+// The compilers the mbed uses don't all understand constexpr, so this is done
+// with a template and integer constant expressions instead. Select a robot in
+// robot_specific.h.
+
+#ifndef JDH_16_17_RASPI3_ROBOT_PROFILE_H_
+#define JDH_16_17_RASPI3_ROBOT_PROFILE_H_
+
+#include <stdint.h>
+
+// |wheel_diameter| and |robot_diameter| (the distance between the middle of
+// the wheels) are in micrometres; |steps_per_rotation| is how many steps the
+// motors take to go round once.
+template <uint32_t wheel_diameter, uint32_t robot_diameter, uint32_t steps_per_rotation>
+struct RobotProfile {
+    // Pi is 355/113 here, which is good to better than one part in ten million.
+    // The number of steps to take to move one centimetre (probably about 80).
+    static const uint32_t kStepsPerCentimetre = (uint32_t)(
+        ((uint64_t)steps_per_rotation * 10000 * 113 * 65536 + 355 * wheel_diameter / 2)
+        / (355 * (uint64_t)wheel_diameter));
+    // The number of steps to take to rotate one degree (probably about 27). Pi
+    // cancels out: it's the ratio of the two circumferences, times the steps
+    // per rotation, over 360.
+    static const uint32_t kStepsPerDegree = (uint32_t)(
+        ((uint64_t)robot_diameter * steps_per_rotation * 65536 + 360 * wheel_diameter / 2)
+        / (360 * (uint64_t)wheel_diameter));
+    // The number of steps the middle of the robot takes along an arc, per
+    // degree of the arc per centimetre of its radius (probably about 1.3). Pi
+    // cancels out here too.
+    static const uint32_t kStepsPerDegreeCentimetre = (uint32_t)(
+        ((uint64_t)steps_per_rotation * 10000 * 65536 + 180 * wheel_diameter / 2)
+        / (180 * (uint64_t)wheel_diameter));
+};
+
+// |count| lots of a Q16.16 |scale|, to the nearest whole number. On the
+// Cortex-M3 this is one long multiply and a shift. A 64-bit product is needed
+// because 'F' 255 comes to about 2^34 in Q16.16.
+inline int32_t ScaleQ16(int32_t count, uint32_t scale) {
+    return (int32_t)(((int64_t)count * scale + 0x8000) >> 16);
+}
+
+// The same, for a |count| in units |divisor| times smaller than |scale|'s,
+// e.g. millimetres with kStepsPerCentimetre and a |divisor| of 10.
+inline int32_t ScaleQ16(int64_t count, uint32_t scale, int32_t divisor) {
+    return (int32_t)((count * scale / divisor + 0x8000) >> 16);
+}
+
+#endif  // JDH_16_17_RASPI3_ROBOT_PROFILE_H_
\ No newline at end of file
@@ -14,35 +14,71 @@
 
 /****************** These should be updated for each robot. *******************/
 
-// The diameter of the wheels, in centimetres.
-const double kWheelDiameter = 13.36;
-// Prototype = 13.36
-
-// The distance between the middle of the wheels, in centimetres. Increasing
-// this number will decrease the number of steps the robot takes per degree.
-const double kRobotDiameter = 40.30;  // 42.79 * 17/18 * 359/360
-// Prototype = 42.79
+// The size of the wheels and of the robot is in robot_specific.h.
 
 /************** These will probably be OK to leave as they are. ***************/
 
-// The number of steps the motors must take to rotate 360 degrees.
-const int kStepsPerRotation = 3200;
-
-// The number of steps to accelerate and decelerate for.
-const int kAccelDecelSteps = 7000;
-
-// The number of steps to accelerate for when in the low-power state.
-const int kAccelLowPowerSteps = 2000;
-
-// The initial PWM period, in microseconds.
+// The top speed, in steps per second. The old 1us-per-tick ramp topped out at
+// about 3800 on a long 'F' move.
+const int kMaxStepRate = 3800;
+
+// How quickly the robot may speed up and slow down, in steps per second per
+// second. Too high and the motors will skip steps at the start of a move.
+const int kMaxStepAcceleration = 2500;
+
+// How quickly the acceleration may change, in steps per second cubed. Zero
+// gives a trapezoidal profile (the acceleration is switched on and off
+// instantly); anything else gives a smoother S-curve that takes a little longer.
+const int kMaxStepJerk = 0;
+
+// The motor board voltage (as a fraction, as seen on p15) at and above which
+// the motors have torque to spare at kMaxStepRate and kMaxStepAcceleration,
+// and the one at which they can only just turn at the starting speed. In
+// between, the top speed and acceleration are scaled down with the voltage
+// (see motion_profile.h). Neither has been measured on the robot yet:
+// kFullTorqueLevel is where the robot has always switched to low power, so
+// a healthy battery gets the same top speed as it always did.
+const double kFullTorqueLevel = 0.6;
+const double kStallLevel = 0.45;
+
+// The initial PWM period, in microseconds. The motors can start from standstill
+// at this speed without needing to accelerate.
 const int kInitialPwmPeriod = 1500;
 
-// How much to change the PWM period by at a time, in microseconds.
-const int kPwmPeriodIncrement = 1;  // was 15
-
-// The voltage at the motor boards, as a fraction, at which the robot should
-// take action to decrease the likelihood of the motors stalling.
-const double kLowPowerThreshold = 0.6;
+// The motor board voltage, as a fraction, that low-power moves ('A') are
+// profiled for whenever the supply is higher, so that they go gently whatever
+// the battery is doing. Half way between kStallLevel and kFullTorqueLevel,
+// they get half the torque margin: about 2200 steps/s at most.
+const double kLowPowerLevel = 0.525;
+
+// 1 if the gyro's Z rate is positive when the robot turns left (its Z axis
+// points up), -1 if it's mounted upside down.
+const int kGyroLeftTurnSign = 1;
+
+// How far out a turn may finish, in degrees as measured by the gyro, before
+// the robot trims it (and how many goes it gets at that). Much under half a
+// degree and the gyro's own drift starts to matter.
+const double kTurnTolerance = 0.5;
+const int kMaxTurnTrims = 2;
+
+// The furthest the robot goes after a collision before it stops, in steps
+// (about 3 cm). It slows down as hard as it has to to stop in that distance,
+// but no harder than 16 entries of the profile a step, so at the very top of
+// a long ramp it can take a bit further.
+const int kMaxPauseSteps = 240;
+
+// How often to send a telemetry frame (see telemetry.h) until the Pi asks for
+// something else, in milliseconds; 0 for none. A frame is 30 bytes, so at
+// 115200 baud p9 can take one about every 2.6 ms.
+const int kTelemetryPeriodMs = 10;
+
+// At start-up, the wheels are enabled once the voltage at the motor boards (as
+// a fraction) has been over kMotorPowerLevel and within kPowerSettleBand of
+// where it was for kPowerSettleMs, i.e. it has stopped rising as the boards'
+// capacitors charge. That used to be a flat second.
+const double kMotorPowerLevel = 0.5;
+const double kPowerSettleBand = 0.01;
+const int kPowerSettleMs = 100;
 
 // The pins that the motor control boards' DIR pins are connected to.
 DigitalOut right_wheel_direction(p16);
@@ -64,21 +100,15 @@ void RightWheelBack() {right_wheel_direction = 0;}
 
 /******************** These shouldn't usually be changed. *********************/
 
-// This isn't defined in the mbed's math.h, so we define it here (unexported).
-const double kPi = 3.14159265358979323846;
-
-// Unexported.
-const double kWheelCircumference = kWheelDiameter * kPi;
-const double kRobotCircumference = kRobotDiameter * kPi;
-
-// The number of steps to take to move one centimetre (probably about 80).
-const double kStepsPerCentimetre = kStepsPerRotation / kWheelCircumference;
-// The number of steps to take to rotate one degree (probably about 34).
-const double kStepsPerDegree = kRobotCircumference / kWheelCircumference
-                               * kStepsPerRotation / 360;
-
+#if SEPARATE_STEP_CLOCKS
+// The pins that the left and right motor control boards' CLK pins are
+// connected to.
+PwmOut pwm(p23);
+PwmOut right_pwm(p24);
+#else
 // The pin that *both* motor control boards' CLK pins are connected to.
 PwmOut pwm(p23);
+#endif
 
 // The USB serial connection.
 Serial usb_serial(USBTX, USBRX);
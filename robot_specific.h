@@ -12,16 +12,89 @@
 #define JDH_16_17_RASPI3_ROBOT_SPECIFIC_H_
 
 #include "mbed.h"
+#include "robot_profile.h"
 
-extern const double kWheelDiameter;
-extern const double kRobotDiameter;
+// Whether p23 (the CLK output) is also wired to p30, so that TIMER2 can count
+// the steps in hardware. PwmHandler then only has to run whilst the robot is
+// changing speed, instead of on every step. Only set this to 1 once the wire
+// is there: without it the robot will never stop! Left at 0, PwmHandler counts
+// every step itself, as it always has.
+#ifndef STEP_COUNTER_TIMER
+#define STEP_COUNTER_TIMER 0
+#endif
 
-extern const int kStepsPerRotation;
-extern const int kAccelDecelSteps;
-extern const int kAccelLowPowerSteps;
+// Whether the GPDMA controller should write each step's period into the PWM,
+// instead of PwmHandler doing it (see step_stream.h). The processor is then
+// only interrupted at the start and end of each move, and when something
+// changes the plan. Uses the same wire as STEP_COUNTER_TIMER.
+#ifndef STEP_PERIOD_DMA
+#define STEP_PERIOD_DMA 0
+#endif
+#if STEP_PERIOD_DMA && !STEP_COUNTER_TIMER
+#error "STEP_PERIOD_DMA needs STEP_COUNTER_TIMER (p23 wired to p30)"
+#endif
+
+// Whether the right motor board's CLK pin is wired to p24, instead of sharing
+// p23 with the left one. The wheels can then take steps at different rates,
+// which arcs ('L' and 'R') need; without it, they're refused with an 'x'. Both
+// pins are driven by PWM1, so they still share one period: the inner wheel of
+// an arc just skips some of the pulses (see interrupt_handlers.cpp).
+#ifndef SEPARATE_STEP_CLOCKS
+#define SEPARATE_STEP_CLOCKS 0
+#endif
+
+// Whether the interrupt handlers time themselves with the cycle counter (see
+// isr_profile.h). It costs a few dozen cycles per interrupt, so leave it off
+// unless you're going to ask for the numbers.
+#ifndef ISR_PROFILING
+#define ISR_PROFILING 0
+#endif
+
+// Whether to stream what the robot is doing out of p9 (see telemetry.h). It
+// uses GPDMA channel 2 and UART3, and a little of main()'s time.
+#ifndef TELEMETRY
+#define TELEMETRY 1
+#endif
+
+// Which robot to build for: 0 for the competition robot, 1 for the prototype.
+#ifndef ROBOT_PROTOTYPE
+#define ROBOT_PROTOTYPE 0
+#endif
+
+// The size of each robot, which should be updated if its wheels are changed.
+// These live here rather than in robot_specific.cpp so that the steps per
+// centimetre and per degree are known at compile time (see robot_profile.h).
+// Both robots have 13.36 cm wheels and motors that take 3200 steps to turn
+// once. Increasing the robot diameter will decrease the number of steps the
+// robot takes per degree.
+#if ROBOT_PROTOTYPE
+typedef RobotProfile<133600, 427900, 3200> Robot;
+#else
+typedef RobotProfile<133600, 403000, 3200> Robot;  // 42.79 * 17/18 * 359/360
+#endif
+
+// All in Q16.16 fixed point. These are only the starting point: the robot
+// goes by steps_per_centimetre and so on (see calibration.h), which can be
+// measured on the robot and kept in flash.
+const uint32_t kDefaultStepsPerCentimetre = Robot::kStepsPerCentimetre;
+const uint32_t kDefaultStepsPerDegree = Robot::kStepsPerDegree;
+const uint32_t kDefaultStepsPerDegreeCentimetre = Robot::kStepsPerDegreeCentimetre;
+
+extern const int kMaxStepRate;
+extern const int kMaxStepAcceleration;
+extern const int kMaxStepJerk;
+extern const double kFullTorqueLevel;
+extern const double kStallLevel;
 extern const int kInitialPwmPeriod;
-extern const int kPwmPeriodIncrement;
-extern const double kLowPowerThreshold;
+extern const double kLowPowerLevel;
+extern const int kGyroLeftTurnSign;
+extern const double kTurnTolerance;
+extern const int kMaxTurnTrims;
+extern const int kMaxPauseSteps;
+extern const int kTelemetryPeriodMs;
+extern const double kMotorPowerLevel;
+extern const double kPowerSettleBand;
+extern const int kPowerSettleMs;
 extern DigitalOut right_wheel_direction;
 extern DigitalOut left_wheel_direction;
 extern DigitalOut left_wheel_enable;
@@ -32,9 +105,10 @@ void LeftWheelBack();
 void RightWheelForward();
 void RightWheelBack();
 
-extern const double kStepsPerCentimetre;
-extern const double kStepsPerDegree;
 extern PwmOut pwm;
+#if SEPARATE_STEP_CLOCKS
+extern PwmOut right_pwm;
+#endif
 extern Serial usb_serial;
 extern Ticker ticker;
 extern BusIn dip_switch;
@@ -0,0 +1,54 @@
+/* scheduler.cpp
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+#include "scheduler.h"
+
+#include "mbed.h"
+
+static volatile uint32_t posted = 0;
+static SchedulerTask tasks[kSchedulerEvents];
+
+void SetTask(SchedulerEvent event, SchedulerTask task) {
+    for (int i = 0; i < kSchedulerEvents; i++) {
+        if (event == 1u << i) {
+            tasks[i] = task;
+        }
+    }
+}
+
+void PostEvent(uint32_t events) {
+    // As it may be called with interrupts already off, leave them as they were.
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    posted |= events;
+    __set_PRIMASK(primask);
+}
+
+void RunScheduler() {
+    while (1) {
+        __disable_irq();
+        uint32_t events = posted;
+        if (events == 0) {
+            // An interrupt still wakes the processor with them disabled (and
+            // is taken as soon as they're enabled again), so one that posts an
+            // event between the check and the WFI can't be slept through.
+            __WFI();
+            __enable_irq();
+            continue;
+        }
+        int i = 0;
+        while (!(events & (1u << i))) {
+            i++;
+        }
+        posted = events & ~(1u << i);
+        __enable_irq();
+        if (tasks[i]) {
+            tasks[i]();
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+/* scheduler.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// Once the robot is set up, everything main() does is in response to an
+// event posted by an interrupt handler: a batch of gyro samples waiting, bytes
+// from the Pi, and so on. Each event has a task, which RunScheduler() runs to
+// completion (they're never interrupted by each other, only by the interrupt
+// handlers) once its event is posted, most urgent first. With nothing posted,
+// the processor sleeps until the next interrupt.
+//
+// An event waits for no more than the task that's running and the tasks for
+// any more urgent ones, so keep tasks short: a task with more to do than it
+// should do in one go can post its own event again to carry on after the
+// others have had a turn. Posting an event that's already posted does
+// nothing, so a task runs once for however many posts there were since it
+// last started.
+
+#ifndef JDH_16_17_RASPI3_SCHEDULER_H_
+#define JDH_16_17_RASPI3_SCHEDULER_H_
+
+#include <stdint.h>
+
+// Most urgent first.
+enum SchedulerEvent {
+    kEventMoveStarted = 1 << 0,  // PwmHandler has set off from rest
+    kEventGyroData = 1 << 1,     // GyroDataReady: a batch of samples is waiting
+    kEventSerialRx = 1 << 2,     // SerialHandler: there are bytes in serial_rx
+    kEventMoveDone = 1 << 3,     // a move has finished, and its reply has gone
+    kEventBattery = 1 << 4       // BatteryHandler: about 720 times a second
+};
+const int kSchedulerEvents = 5;
+
+typedef void (*SchedulerTask)();
+
+// Sets the task for |event|; an event without one is just forgotten.
+void SetTask(SchedulerEvent event, SchedulerTask task);
+// Safe to call from anywhere, including interrupt handlers.
+void PostEvent(uint32_t events);
+// Runs the tasks, forever. (Saying so lets main() end with it.)
+void RunScheduler() __attribute__((noreturn));
+
+#endif  // JDH_16_17_RASPI3_SCHEDULER_H_
\ No newline at end of file
@@ -0,0 +1,104 @@
+/* serial_tx.cpp
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+#include "serial_tx.h"
+
+#include "mbed.h"
+
+#include "robot_specific.h"
+#include "isr_profile.h"
+
+// Both main() and the interrupt handlers send things, so unlike RingBuffer
+// this has more than one producer. Rather than keeping interrupts off whilst a
+// whole frame is copied in, a sender reserves the space it needs with them off
+// for a moment, copies its bytes in with them on, and then says it's done. An
+// interrupt handler can only get in between main()'s reserving and finishing
+// (they don't interrupt each other), so bytes become ready to go, up to
+// |reserved|, whenever nobody is part-way through. The buffer's indices run
+// freely and wrap, as in RingBuffer.
+static char buffer[kSerialTxBufferSize];
+// The next byte for the UART. Only moved with interrupts off, or by
+// SerialTxHandler.
+static volatile unsigned int head = 0;
+// Everything before this is in the buffer and can be sent.
+static volatile unsigned int ready = 0;
+// Everything before this has been handed out to a sender.
+static volatile unsigned int reserved = 0;
+// Senders that have reserved space and not yet filled it.
+static volatile int filling = 0;
+static volatile unsigned int serial_tx_high_water = 0;
+volatile int serial_tx_dropped = 0;
+
+// Reserves |length| bytes of the buffer, and returns where they start, or
+// returns false if there isn't room.
+static bool Reserve(int length, unsigned int* start) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    unsigned int waiting = reserved - head;
+    bool room = kSerialTxBufferSize - waiting >= (unsigned int)length;
+    if (room) {
+        *start = reserved;
+        reserved += length;
+        filling++;
+    } else {
+        serial_tx_dropped += length;
+    }
+    __set_PRIMASK(primask);
+    return room;
+}
+
+// Call once the bytes from Reserve() are all in the buffer.
+static void Finish() {
+    __DMB();  // the bytes have to be there before anyone can send them
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (--filling == 0) {
+        ready = reserved;
+    }
+    // If the FIFO is empty, no THRE interrupt is coming to send these, so send
+    // the first one here, and its THRE will see to the rest.
+    if (head != ready && usb_serial.writeable()) {
+        usb_serial.putc(buffer[head % kSerialTxBufferSize]);
+        head++;
+    }
+    if (reserved - head > serial_tx_high_water) {
+        serial_tx_high_water = reserved - head;
+    }
+    __set_PRIMASK(primask);
+}
+
+bool SerialSend(char character) {
+    return SerialSendBytes(&character, 1);
+}
+
+bool SerialSendBytes(const char* bytes, int length) {
+    unsigned int start;
+    if (!Reserve(length, &start)) {
+        return false;
+    }
+    for (int i = 0; i < length; i++) {
+        buffer[(start + i) % kSerialTxBufferSize] = bytes[i];
+    }
+    Finish();
+    return true;
+}
+
+// This is called when the UART's transmit FIFO has emptied. Refill it from the
+// buffer; putc() won't wait here, since writeable() says there's room.
+void SerialTxHandler() {
+    PROFILE_ISR(kProfileSerialTxHandler);
+    while (head != ready && usb_serial.writeable()) {
+        __DMB();
+        usb_serial.putc(buffer[head % kSerialTxBufferSize]);
+        head++;
+    }
+}
+
+unsigned int SerialTxHighWater() {
+    return serial_tx_high_water;
+}
\ No newline at end of file
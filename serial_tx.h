@@ -0,0 +1,39 @@
+/* serial_tx.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// Everything sent to the Pi goes through here rather than straight to
+// usb_serial.putc(), which waits if the UART's FIFO is full -- and waiting
+// inside PwmHandler means missing steps. SerialSend() never waits: it puts
+// the byte in the FIFO if there's room, and otherwise leaves it in a buffer
+// for SerialTxHandler to pass on as the FIFO empties.
+
+#ifndef JDH_16_17_RASPI3_SERIAL_TX_H_
+#define JDH_16_17_RASPI3_SERIAL_TX_H_
+
+// Must be a power of two. At 115200 baud, 128 bytes take 11 ms to send.
+// (Framed replies are several bytes each, and up to 38 for the answers to
+// kOpIsrProfile and kOpIsrHistogram; see frames.h.)
+const unsigned int kSerialTxBufferSize = 128;
+
+// Safe to call from anywhere, including interrupt handlers. Returns false if
+// the buffer was full and the byte was thrown away.
+bool SerialSend(char character);
+// The same for |length| bytes, which go out together or (if there isn't room
+// for all of them) not at all, so that nothing else gets sent in between.
+// Interrupts are only held off for a few instructions, however long it is.
+bool SerialSendBytes(const char* bytes, int length);
+// Attach to usb_serial's TxIrq.
+void SerialTxHandler();
+
+// The most bytes that have ever been waiting in the buffer at once, so you can
+// tell how close it has come to filling up.
+unsigned int SerialTxHighWater();
+// Bytes thrown away because the buffer was full.
+extern volatile int serial_tx_dropped;
+
+#endif  // JDH_16_17_RASPI3_SERIAL_TX_H_
\ No newline at end of file
@@ -0,0 +1,281 @@
+/* step_stream.cpp
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+#include "step_stream.h"
+
+#include "mbed.h"
+
+#include "robot_specific.h"
+
+#if STEP_PERIOD_DMA
+
+#include "pwm_constants.h"
+#include "timer_constants.h"
+#include "gpdma_constants.h"
+#include "motion_profile.h"
+
+// A plan longer than this many links is done in instalments: the last link
+// interrupts, and StreamInterrupt() plans the next lot. At most 4095 steps fit
+// in a link, so this is enough for any single move up to about 100000 steps.
+const int kMaxStreamLinks = 32;
+
+// The DMA writes whole words to the PWM, so it needs its own copies of
+// step_periods: one going up the ramp and one coming down it, since it can
+// only step forwards through memory. They fill the two 16K banks of AHB RAM.
+static uint32_t periods_up[kMaxRampSteps] __attribute__((section("AHBSRAM0")));
+static uint32_t periods_down[kMaxRampSteps] __attribute__((section("AHBSRAM1")));
+static const uint32_t latch_mr0 = PWM_LER_MR0;
+static int pulse_ticks = 0;
+
+static LPC_GPDMACH_TypeDef* const period_channel = LPC_GPDMACH0;
+static LPC_GPDMACH_TypeDef* const latch_channel = LPC_GPDMACH1;
+
+static GpdmaLink links[kMaxStreamLinks];
+static int link_ends[kMaxStreamLinks];  // position once each link is done
+static int link_count = 0;
+static GpdmaLink latch_link;  // links to itself, so it never runs out
+
+static int ends[kMaxStreamEnds];
+static int end_count = 0;
+
+// The current plan: from |plan_done| steps in, having just used entry
+// |plan_step| of the profile, stopping at |plan_stop| with ramp_limit at
+// |plan_limit|.
+static int plan_done = 0;
+static int plan_step = 0;
+static int plan_stop = 0;
+static int plan_limit = 1;
+// How far the links built so far go, whilst building them.
+static int planned = 0;
+static int end_index = 0;
+
+// Where the channel has got to, from which link it's on and how much of it
+// is left. Only exact once the channel has been halted.
+static int LinkPosition() {
+    if (link_count == 0) {
+        return plan_done;
+    }
+    if (!(period_channel->DMACCConfig & GPDMA_CONFIG_ENABLE)) {
+        return link_ends[link_count - 1];  // finished
+    }
+    uint32_t next = period_channel->DMACCLLI;
+    int remaining = period_channel->DMACCControl & GPDMA_CONTROL_SIZE_MASK;
+    int link = link_count - 1;
+    if (next != 0) {
+        link = (int)((next - (uint32_t)&links[0]) / sizeof(GpdmaLink)) - 1;
+    }
+    return link_ends[link] - remaining;
+}
+
+// The entry of step_periods that step |step| uses under the current plan.
+// This is what NextStepPeriod() would have done, in closed form.
+static int PlannedStep(int step) {
+    if (step <= plan_done + 1) {
+        return plan_step;
+    }
+    int s = plan_step + step - plan_done - 1;
+    if (s > plan_limit - 1) {
+        s = plan_limit - 1;
+    }
+    if (s > plan_stop - step) {
+        s = plan_stop - step;
+    }
+    return s < 0 ? 0 : s;
+}
+
+// Appends links for |count| transfers from |source|, splitting them where a
+// move ends (so that the link can interrupt) and where they'd be too long.
+// Returns false if there's no room for all of them.
+static bool AddTransfers(const uint32_t* source, bool increment, int count) {
+    while (count > 0) {
+        if (link_count == kMaxStreamLinks) {
+            return false;
+        }
+        while (end_index < end_count && ends[end_index] <= planned) {
+            end_index++;
+        }
+        int n = count < GPDMA_CONTROL_MAX_SIZE ? count : GPDMA_CONTROL_MAX_SIZE;
+        uint32_t control = GPDMA_CONTROL_SWIDTH_WORD | GPDMA_CONTROL_DWIDTH_WORD;
+        if (end_index < end_count && planned + n >= ends[end_index]) {
+            n = ends[end_index] - planned;
+            control |= GPDMA_CONTROL_INT;
+        }
+        if (increment) {
+            control |= GPDMA_CONTROL_SI;
+        }
+        GpdmaLink& link = links[link_count];
+        link.source = (uint32_t)source;
+        link.destination = (uint32_t)&LPC_PWM1->MR0;
+        link.next = 0;
+        link.control = control | n;
+        if (link_count > 0) {
+            links[link_count - 1].next = (uint32_t)&link;
+        }
+        planned += n;
+        link_ends[link_count++] = planned;
+        if (increment) {
+            source += n;
+        }
+        count -= n;
+    }
+    return true;
+}
+
+// Halts the period channel, and returns exactly how far it got. Any DMA request
+// that comes in meanwhile waits for the channel to be started again.
+static int HaltStream() {
+    period_channel->DMACCConfig |= GPDMA_CONFIG_HALT;
+    while (period_channel->DMACCConfig & GPDMA_CONFIG_ACTIVE) {}
+    int position = LinkPosition();
+    period_channel->DMACCConfig = 0;
+    return position;
+}
+
+// Builds the links from |done| steps in, where step |done| + 1 uses entry
+// |step| of the profile, and starts the channels going.
+static void Plan(int done, int step) {
+    plan_done = done;
+    plan_step = step;
+    plan_limit = ramp_limit;
+    plan_stop = ends[end_count - 1] > done ? ends[end_count - 1] : done + 1;
+    link_count = 0;
+    planned = done;
+    end_index = 0;
+
+    // Transfer j happens at the end of step j, and sets the period of step
+    // k = j + 1, which uses entry min(step + k - done - 1, plan_limit - 1,
+    // plan_stop - k): speeding up, at top speed, then slowing down.
+    int start = step - done - 1;
+    int k = done + 2;
+    int up_end = plan_limit - 1 - start;
+    if ((plan_stop - start) / 2 < up_end) {
+        up_end = (plan_stop - start) / 2;
+    }
+    if (plan_stop < up_end) {
+        up_end = plan_stop;
+    }
+    bool room = true;
+    if (up_end >= k) {
+        room = AddTransfers(&periods_up[start + k], true, up_end - k + 1);
+        k = up_end + 1;
+    }
+    int top_end = plan_stop - (plan_limit - 1);
+    if (room && top_end >= k) {
+        room = AddTransfers(&periods_up[plan_limit - 1], false, top_end - k + 1);
+        k = top_end + 1;
+    }
+    if (room && plan_stop >= k) {
+        room = AddTransfers(&periods_down[ramp_steps - 1 - (plan_stop - k)], true,
+                            plan_stop - k + 1);
+    }
+    // The transfer at the end of the last step has nothing left to set up, but
+    // it's what makes the final interrupt.
+    if (room) {
+        AddTransfers(&periods_up[0], false, 1);
+    }
+    links[link_count - 1].control |= GPDMA_CONTROL_INT;
+
+    period_channel->DMACCSrcAddr = links[0].source;
+    period_channel->DMACCDestAddr = links[0].destination;
+    period_channel->DMACCLLI = links[0].next;
+    period_channel->DMACCControl = links[0].control;
+    period_channel->DMACCConfig = GPDMA_CONFIG_ENABLE | GPDMA_CONFIG_M2P
+                                  | GPDMA_CONFIG_ITC
+                                  | GPDMA_CONFIG_DEST_PERIPHERAL(GPDMA_REQUEST_MAT2_0);
+}
+
+void InitStepStream() {
+    for (int i = 0; i < ramp_steps; i++) {
+        periods_up[i] = step_periods[i];
+        periods_down[ramp_steps - 1 - i] = step_periods[i];
+    }
+    // Short enough to fit inside the shortest step.
+    pulse_ticks = step_periods[ramp_steps - 1] / 2;
+
+    latch_link.source = (uint32_t)&latch_mr0;
+    latch_link.destination = (uint32_t)&LPC_PWM1->LER;
+    latch_link.next = (uint32_t)&latch_link;
+    latch_link.control = GPDMA_CONTROL_SWIDTH_WORD | GPDMA_CONTROL_DWIDTH_WORD
+                         | GPDMA_CONTROL_MAX_SIZE;
+
+    LPC_SC->PCONP |= SC_PCONP_TIM2 | SC_PCONP_GPDMA;
+    LPC_SC->DMAREQSEL |= DMAREQSEL_MAT2_0 | DMAREQSEL_MAT2_1;
+    LPC_GPDMA->DMACConfig = GPDMA_ENABLE;
+
+    // TIMER2 counts step pulses on p30 as with STEP_COUNTER_TIMER, but matches
+    // MR0 and MR1 on every one, for the two DMA requests.
+    LPC_PINCON->PINSEL0 = (LPC_PINCON->PINSEL0 & ~(PINSEL0_P0_4_MASK))
+                          | PINSEL0_P0_4_CAP2_0;
+    LPC_TIM2->TCR = TIM_TCR_RESET;
+    LPC_TIM2->CTCR = TIM_CTCR_COUNT_FALLING_CAP0;
+    LPC_TIM2->PR = 0;
+    LPC_TIM2->MR0 = 0;
+    LPC_TIM2->MR1 = 0;
+    LPC_TIM2->MCR = TIM_MR0_RESET;
+    LPC_TIM2->TCR = TIM_TCR_ENABLE;
+}
+
+int StreamPulseTicks() {
+    return pulse_ticks;
+}
+
+void StartStream() {
+    link_count = 0;
+    plan_done = 0;
+    plan_step = 0;
+    // Forget any DMA request left over from the end of the last move.
+    LPC_TIM2->IR = TIM_IR_MR0 | TIM_IR_MR1;
+    if (!(latch_channel->DMACCConfig & GPDMA_CONFIG_ENABLE)) {
+        latch_channel->DMACCSrcAddr = latch_link.source;
+        latch_channel->DMACCDestAddr = latch_link.destination;
+        latch_channel->DMACCLLI = latch_link.next;
+        latch_channel->DMACCControl = latch_link.control;
+        latch_channel->DMACCConfig = GPDMA_CONFIG_ENABLE | GPDMA_CONFIG_M2P
+                                     | GPDMA_CONFIG_DEST_PERIPHERAL(GPDMA_REQUEST_MAT2_1);
+    }
+}
+
+void PlanStream(const int* new_ends, int count) {
+    int done = HaltStream();
+    int step = PlannedStep(done + 1);
+    end_count = count < kMaxStreamEnds ? count : kMaxStreamEnds;
+    for (int i = 0; i < end_count; i++) {
+        ends[i] = new_ends[i];
+    }
+    Plan(done, step);
+}
+
+bool StreamInterrupt() {
+    int position = LinkPosition();
+    if (position == link_ends[link_count - 1] && position < plan_stop) {
+        Plan(position, PlannedStep(position + 1));
+    }
+    for (int i = 0; i < end_count; i++) {
+        if (ends[i] == position) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void StopStream() {
+    period_channel->DMACCConfig = 0;
+    latch_channel->DMACCConfig = 0;
+    link_count = 0;
+    plan_done = 0;
+}
+
+int StreamPosition() {
+    return LinkPosition();
+}
+
+int StreamProfileStep() {
+    return PlannedStep(LinkPosition() + 1);
+}
+
+#endif  // STEP_PERIOD_DMA
\ No newline at end of file
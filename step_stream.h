@@ -0,0 +1,58 @@
+/* step_stream.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// With STEP_PERIOD_DMA, the period of every step of a move is worked out when
+// the move starts, as a list of runs through the table in motion_profile.h
+// (up the ramp, along at top speed, back down), and the GPDMA controller feeds
+// them to the PWM one per step. The step pulses on p30 (see STEP_COUNTER_TIMER)
+// make TIMER2 match on every step, and each match is a DMA request: channel 0
+// writes the next period into PWM MR0, and channel 1 sets the LER so that it
+// takes effect. Nothing runs on the processor per step.
+//
+// Positions are counted in steps from the start of the move, i.e. since the
+// robot was last at rest. The plan has to be redone (PlanStream()) whenever
+// anything it depends on changes: where the moves end, or ramp_limit. The
+// step pulse is a fixed width, since nothing updates MR4 per step.
+//
+// Only call these from the step interrupts (PwmHandler and StepStreamHandler).
+
+#ifndef JDH_16_17_RASPI3_STEP_STREAM_H_
+#define JDH_16_17_RASPI3_STEP_STREAM_H_
+
+// The most move ends a plan can stop at.
+const int kMaxStreamEnds = 16;
+// The stream uses GPDMA channel 0 for the periods (and 1 for the latch), and
+// this is its bit in the DMA interrupt registers.
+const unsigned int kStreamChannelMask = 1 << 0;
+
+// Sets up TIMER2 and the GPDMA controller, and copies the profile into the
+// tables the DMA reads from. Call once, after BuildMotionProfile().
+void InitStepStream();
+// The width of every step pulse, in PWM ticks.
+int StreamPulseTicks();
+
+// Call when the robot starts moving from rest (its first step having already
+// been set up), before PlanStream().
+void StartStream();
+// Plans the rest of the move from where the robot has got to. |ends| are the
+// positions at which each move finishes, in order; the robot stops at the
+// last. A terminal count interrupt happens at each of them.
+void PlanStream(const int* ends, int count);
+// Call from the DMA interrupt handler for a terminal count on the stream's
+// channel. Returns true if a move has just finished; otherwise the plan had
+// just run out of links, and has been extended.
+bool StreamInterrupt();
+void StopStream();
+
+// Roughly how many steps the robot has taken in this move (it may be about to
+// take another).
+int StreamPosition();
+// Roughly where in step_periods the current step is.
+int StreamProfileStep();
+
+#endif  // JDH_16_17_RASPI3_STEP_STREAM_H_
\ No newline at end of file
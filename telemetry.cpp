@@ -0,0 +1,203 @@
+/* telemetry.cpp
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+#include "telemetry.h"
+
+#include "mbed.h"
+
+#include "robot_specific.h"
+
+#if TELEMETRY
+
+#include "gpdma_constants.h"
+#include "uart_constants.h"
+#include "frames.h"
+#include "interrupt_handlers.h"
+#include "motion_queue.h"
+#include "battery.h"
+
+// Enough for a dozen or so frames. Must be a power of two.
+const int kTelemetryBufferSize = 512;
+// Never send less than one frame in 2^this.
+const int kMaxSubsampleShift = 6;
+
+static LPC_GPDMACH_TypeDef* const channel = LPC_GPDMACH2;
+
+static uint8_t buffer[kTelemetryBufferSize];
+// Frames go in at |head|; the DMA is sending the |sending| bytes from |tail|.
+// Only main() touches these, so there are no races.
+static int head = 0;
+static int tail = 0;
+static int sending = 0;
+
+static uint32_t period_us = 0;
+static uint32_t next_due = 0;
+static uint8_t sequence = 0;
+static int subsample_shift = 0;
+// Whether the last frame was dropped. It takes a while for the buffer to
+// empty, so the rate is only halved once for each run of drops.
+static bool dropping = false;
+static uint32_t dropped = 0;
+
+static int BytesQueued() {
+    return (head - tail) & (kTelemetryBufferSize - 1);
+}
+
+// Once the DMA has finished with what it was given, gives it the next lot: as
+// much as there is up to the end of the buffer, since it can only go forwards
+// through memory.
+static void StartSending() {
+    if (channel->DMACCConfig & GPDMA_CONFIG_ENABLE) {
+        return;  // still going
+    }
+    tail = (tail + sending) & (kTelemetryBufferSize - 1);
+    sending = (head >= tail ? head : kTelemetryBufferSize) - tail;
+    if (sending == 0) {
+        return;
+    }
+    channel->DMACCSrcAddr = (uint32_t)&buffer[tail];
+    channel->DMACCDestAddr = (uint32_t)&LPC_UART3->THR;
+    channel->DMACCLLI = 0;
+    channel->DMACCControl = sending | GPDMA_CONTROL_SWIDTH_BYTE
+                            | GPDMA_CONTROL_DWIDTH_BYTE | GPDMA_CONTROL_SI;
+    channel->DMACCConfig = GPDMA_CONFIG_ENABLE | GPDMA_CONFIG_M2P
+                           | GPDMA_CONFIG_DEST_PERIPHERAL(GPDMA_REQUEST_UART3_TX);
+}
+
+// Puts a frame around |body| and queues it, unless there isn't room.
+static bool QueueFrame(const uint8_t* body) {
+    const int length = kTelemetryBody + 3;
+    if (kTelemetryBufferSize - 1 - BytesQueued() < length) {
+        return false;
+    }
+    uint8_t frame[length];
+    frame[0] = kFrameSync;
+    frame[1] = kTelemetryBody;
+    uint8_t crc = Crc8(0, kTelemetryBody);
+    for (int i = 0; i < kTelemetryBody; i++) {
+        frame[2 + i] = body[i];
+        crc = Crc8(crc, body[i]);
+    }
+    frame[length - 1] = crc;
+    for (int i = 0; i < length; i++) {
+        buffer[head] = frame[i];
+        head = (head + 1) & (kTelemetryBufferSize - 1);
+    }
+    return true;
+}
+
+static uint16_t Saturate16(int32_t value) {
+    return value > 0xFFFF ? 0xFFFF : (value < 0 ? 0 : (uint16_t)value);
+}
+
+void InitTelemetry() {
+    LPC_SC->PCONP |= SC_PCONP_GPDMA;
+    LPC_SC->DMAREQSEL &= ~(DMAREQSEL_MAT3_0);
+    LPC_GPDMA->DMACConfig = GPDMA_ENABLE;
+    LPC_UART3->FCR = UART_FCR_FIFO_ENABLE | UART_FCR_RX_RESET | UART_FCR_TX_RESET
+                     | UART_FCR_DMA_MODE;
+    SetTelemetryPeriod(kTelemetryPeriodMs);
+}
+
+// Queues a frame with sequence number |seq|, or counts it as dropped.
+static void SendTelemetryFrame(const GyroTelemetry& gyro, uint8_t seq, uint32_t now) {
+    MotionSnapshot motion_now;
+    ReadMotion(&motion_now);
+    CurrentCommand command = motion_now.command;
+    bool moving = command != kNone;
+    BatteryReading battery = ReadBattery();
+    uint8_t flags = 0;
+    if (SegmentsQueued()) {
+        flags |= kTelemetryQueued;
+    }
+    if (motion_now.collided) {
+        flags |= kTelemetryCollision;
+    }
+    if (gyro.detector_ignoring) {
+        flags |= kTelemetryIgnoring;
+    }
+    if (motion_now.low_power) {
+        flags |= kTelemetryLowPower;
+    }
+    if (motion_now.checking_turn) {
+        flags |= kTelemetryTurnCheck;
+    }
+
+    uint8_t body[kTelemetryBody];
+    uint8_t* next = body;
+    *next++ = 'T';
+    *next++ = seq;
+    *next++ = (uint8_t)subsample_shift;
+    next = Write32(next, now);
+    next = Write32(next, motion_now.steps_gone);
+    next = Write32(next, motion_now.steps_left);
+    // Whatever is setting the period (PwmHandler or the DMA), this is it.
+    next = Write16(next, moving ? LPC_PWM1->MR0 : 0);
+    next = Write16(next, (uint16_t)gyro.rate);
+    next = Write16(next, Saturate16(gyro.detector_level));
+    next = Write16(next, battery.level);
+    next = Write16(next, battery.sag);
+    *next++ = (uint8_t)command;
+    *next++ = flags;
+
+    if (!QueueFrame(body)) {
+        dropped++;
+        if (!dropping && subsample_shift < kMaxSubsampleShift) {
+            subsample_shift++;
+        }
+        dropping = true;
+        return;
+    }
+    dropping = false;
+    if (subsample_shift > 0 && BytesQueued() <= kTelemetryBody + 3) {
+        subsample_shift--;
+    }
+    StartSending();
+}
+
+void UpdateTelemetry(const GyroTelemetry& gyro) {
+    StartSending();
+    if (period_us == 0) {
+        return;
+    }
+    uint32_t now = us_ticker_read();
+    if ((int32_t)(now - next_due) < 0) {
+        return;
+    }
+    next_due += period_us;
+    if ((int32_t)(now - next_due) >= 0) {
+        // main() has been held up; don't try to catch up.
+        next_due = now + period_us;
+    }
+    uint8_t seq = sequence++;
+    if (seq & ((1 << subsample_shift) - 1)) {
+        return;
+    }
+    SendTelemetryFrame(gyro, seq, now);
+}
+
+void SendTelemetryNow(const GyroTelemetry& gyro) {
+    StartSending();
+    if (period_us == 0) {
+        return;
+    }
+    SendTelemetryFrame(gyro, sequence++, us_ticker_read());
+}
+
+void SetTelemetryPeriod(int ms) {
+    period_us = ms > 0 ? ms * 1000 : 0;
+    next_due = us_ticker_read();
+    subsample_shift = 0;
+    dropping = false;
+}
+
+uint32_t TelemetryDropped() {
+    return dropped;
+}
+
+#endif  // TELEMETRY
\ No newline at end of file
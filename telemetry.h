@@ -0,0 +1,74 @@
+/* telemetry.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+// With TELEMETRY, a frame saying what the robot is doing goes out of p9
+// (log_mbed, UART3) every so often, so that the motion and the collision
+// detection can be tuned from real runs; host/telemetry_csv turns a capture of
+// them into CSV. main() puts the frames together (see scheduler.h) and leaves
+// them in a buffer, which GPDMA channel 2 feeds to the UART a byte at a
+// time as it has room: nothing runs on the processor per byte, and there are
+// no interrupts.
+//
+// If the link can't keep up (a frame won't fit in the buffer), the frame is
+// dropped and from then on only every other one is sent, then every fourth,
+// and so on; as the buffer empties, the rate comes back up.
+//
+// Each frame is laid out as in frames.h (kFrameSync, length, body, CRC-8),
+// with a body of kTelemetryBody bytes:
+//     'T'
+//     sequence number (8 bits), counting every frame that was due, sent or not
+//     subsampling (8 bits): 1 in 2^n of the due frames is being sent
+//     time (32 bits), from us_ticker_read()
+//     steps gone and steps left in the current move (32 bits each, signed)
+//     the PWM period, in PWM ticks (16 bits)
+//     the latest gyro Z rate, with its offset taken out (16 bits, signed;
+//     see gyro_bias.h)
+//     how close the collision detector is to triggering (16 bits; see
+//     CollisionDetector::Level())
+//     the battery level and sag (16 bits each; see battery.h)
+//     motion.command (8 bits)
+//     flags (8 bits; see TelemetryFlag)
+// The steps, the command and the collision and turn check flags are all from
+// the same moment (see ReadMotion()). The steps and the period are 0 when the
+// robot isn't moving. There's always a frame as each move finishes, as well as
+// the regular ones.
+
+#ifndef JDH_16_17_RASPI3_TELEMETRY_H_
+#define JDH_16_17_RASPI3_TELEMETRY_H_
+
+#include <stdint.h>
+
+const int kTelemetryBody = 27;
+
+enum TelemetryFlag {
+    kTelemetryQueued = 1 << 0,     // moves are waiting in the motion queue
+    kTelemetryCollision = 1 << 1,  // motion.collided
+    kTelemetryIgnoring = 1 << 2,   // the detector is held off (ignore_for)
+    kTelemetryLowPower = 1 << 3,   // the current move is low power ('A')
+    kTelemetryTurnCheck = 1 << 4   // a turn is settling (checking_turn)
+};
+
+// What main() knows about the gyro, which the interrupt handlers don't.
+struct GyroTelemetry {
+    int16_t rate;            // the latest sample
+    int32_t detector_level;  // CollisionDetector::Level()
+    bool detector_ignoring;  // whilst a move settles
+};
+
+// Sets up UART3 and the DMA; call once log_mbed has its baud rate.
+void InitTelemetry();
+// Call from main() often enough for the period: sends a frame if one is due.
+void UpdateTelemetry(const GyroTelemetry& gyro);
+// Sends a frame now, due or not (if there's room for it).
+void SendTelemetryNow(const GyroTelemetry& gyro);
+// How often to send a frame, in milliseconds; 0 stops them.
+void SetTelemetryPeriod(int ms);
+// Frames that didn't fit in the buffer, since InitTelemetry().
+uint32_t TelemetryDropped();
+
+#endif  // JDH_16_17_RASPI3_TELEMETRY_H_
\ No newline at end of file
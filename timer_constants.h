@@ -0,0 +1,56 @@
+/* timer_constants.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+#ifndef JDH_16_17_RASPI3_TIMER_CONSTANTS_H_
+#define JDH_16_17_RASPI3_TIMER_CONSTANTS_H_
+
+// Datasheet: <https://www.nxp.com/documents/user_manual/UM10360.pdf>
+// See page 490 for details on the timers. TIMER3 belongs to mbed (it runs
+// wait() and Ticker), so leave it alone; TIMER2 is used to count steps (see
+// STEP_COUNTER_TIMER in robot_specific.h).
+
+// Interrupt flags for the timer IR (datasheet section 21.6.1). As with the
+// PWM, write a flag to the IR to clear it.
+#define TIM_IR_MR0 1<<0
+#define TIM_IR_MR1 1<<1
+#define TIM_IR_MR2 1<<2
+#define TIM_IR_MR3 1<<3
+#define TIM_IR_CR0 1<<4
+#define TIM_IR_CR1 1<<5
+
+// TCR (Timer Control Register) bits (datasheet section 21.6.2).
+#define TIM_TCR_ENABLE 1<<0
+#define TIM_TCR_RESET 1<<1
+
+// CTCR (Count Control Register) values (datasheet section 21.6.3). In counter
+// mode, TC goes up by one on each edge of the CAPn.0 pin instead of every
+// PCLK. The input must be slower than PCLK / 2, which step pulses always are.
+#define TIM_CTCR_TIMER 0
+#define TIM_CTCR_COUNT_RISING_CAP0 1
+#define TIM_CTCR_COUNT_FALLING_CAP0 2
+#define TIM_CTCR_COUNT_BOTH_CAP0 3
+
+// Interrupt bits for the timer MCR (datasheet section 21.6.8).
+#define TIM_MR0_INTERRUPT 1<<0
+#define TIM_MR1_INTERRUPT 1<<3
+#define TIM_MR2_INTERRUPT 1<<6
+#define TIM_MR3_INTERRUPT 1<<9
+// Reset TC when it matches. With MRn = N, the timer counts 0 to N inclusive, so
+// N + 1 counts per match; with N = 0 it matches on every count.
+#define TIM_MR0_RESET 1<<1
+
+// Power control bit for TIMER2 in LPC_SC->PCONP (datasheet section 4.8.9);
+// TIMER2 and TIMER3 are off after reset.
+#define SC_PCONP_TIM2 1<<22
+
+// PINSEL0 bits 9:8 select the function of P0.4, which is p30 on the mbed;
+// function 3 is CAP2.0 (datasheet section 8.5.1).
+#define PINSEL0_P0_4_MASK 3<<8
+#define PINSEL0_P0_4_CAP2_0 3<<8
+
+#endif  // JDH_16_17_RASPI3_TIMER_CONSTANTS_H_
\ No newline at end of file
@@ -0,0 +1,24 @@
+/* uart_constants.h
+ *
+ * This file is part of the code for the Hills Road/Systemetric entry to the
+ * 2017 Student Robotics competition "Easy as ABC".
+ *
+ * This file is available under CC0. You may use it for any purpose.
+ */
+
+#ifndef JDH_16_17_RASPI3_UART_CONSTANTS_H_
+#define JDH_16_17_RASPI3_UART_CONSTANTS_H_
+
+// Datasheet: <https://www.nxp.com/documents/user_manual/UM10360.pdf>
+// See page 298 for details on UART0/2/3. mbed's Serial sets up the pins, the
+// baud rate and the frame format for us.
+
+// UnFCR (FIFO Control Register) bits (datasheet section 14.4.6). It's write
+// only, so every bit has to be given each time. In DMA mode, the transmitter
+// makes a DMA request whenever there's room in its FIFO.
+#define UART_FCR_FIFO_ENABLE 1<<0
+#define UART_FCR_RX_RESET 1<<1
+#define UART_FCR_TX_RESET 1<<2
+#define UART_FCR_DMA_MODE 1<<3
+
+#endif  // JDH_16_17_RASPI3_UART_CONSTANTS_H_
\ No newline at end of file